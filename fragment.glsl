@@ -1,4 +1,4 @@
-#version 130
+#version 140
 
 out vec4 vertexColor;
 uniform vec2 resolution;
@@ -10,18 +10,61 @@ uniform vec3 u;
 uniform vec3 v;
 uniform float focal;
 
+// objects and lights come as SceneStore columns (see scene.hpp), one float
+// per texel, each column being `stride` (or `lightStride`) texels long
+
+// the counts below are constants in the variants of this shader compiled
+// for a given scene shape (see shaders.hpp), uniforms otherwise
+
 //objects
+#ifdef OBJ_NB
+const int objNb = OBJ_NB;
+#else
 uniform int objNb;
-uniform vec4 spheres[100]; // position and radius
-uniform vec3 colors[100];
-uniform vec3 attr[100];
-  // attributes are, in that order:
-  // diffusion, reflection, shininess (phong)
+#endif
+uniform samplerBuffer spheres;
+uniform int stride;
+  // columns are, in that order:
+  // x, y, z, radius, red, green, blue, diffusion, reflection, shininess (phong)
 
 // lights
 uniform float ambientLight;
+#ifdef LIGHT_NB
+const int lNb = LIGHT_NB;
+#else
 uniform int lNb;
-uniform vec4 lights[10]; // position and intensity
+#endif
+uniform samplerBuffer lights;
+uniform int lightStride;
+  // columns are, in that order:
+  // x, y, z, intensity
+
+// reflections followed, -1 until the attenuation limit
+#ifdef MAX_BOUNCES
+const int maxBounces = MAX_BOUNCES;
+#else
+uniform int maxBounces;
+#endif
+
+// bounding volume hierarchy over the spheres (see bvh.hpp), 0 nodes for none
+uniform int bvhSize;
+uniform samplerBuffer bvhNodes;
+  // two texels per node: min.xyz, escape or first primitive (inner or leaf)
+  //                      max.xyz, spheres in the leaf (0 for inner nodes)
+uniform isamplerBuffer bvhPrims;
+
+// without a BVH, the spheres a shadow ray toward each light may meet (see
+// occluders.hpp), unless occluderLists is 0: light l's are at texels
+// [texel l, texel l + 1)
+uniform int occluderLists;
+uniform isamplerBuffer occluders;
+
+// without a BVH, the spheres the primary rays of each screenTile x screenTile
+// pixels tile may hit (see screentiles.hpp), unless screenTile is 0: tiles
+// row after row, tilesX of them per row, tile t's at [texel t, texel t + 1)
+uniform int screenTile;
+uniform int tilesX;
+uniform isamplerBuffer tileSpheres;
 
 //vec2 p = -.5f + gl_FragCoord.xy / resolution.xy;
 vec2 p = vec2(gl_FragCoord.x - resolution.x / 2, gl_FragCoord.y - resolution.y / 2);
@@ -32,10 +75,39 @@ float dot(vec3 u, vec3 v)
     return u.x * v.x + u.y * v.y + u.z * v.z;
 }
 
+float field(int column, int i)
+{
+    return texelFetch(spheres, column * stride + i).r;
+}
+
+vec4 getSphere(int i) // position and radius
+{
+    return vec4(field(0, i), field(1, i), field(2, i), field(3, i));
+}
+
+vec3 getColor(int i)
+{
+    return vec3(field(4, i), field(5, i), field(6, i));
+}
+
+vec3 getAttr(int i) // diffusion, reflection, shininess
+{
+    return vec3(field(7, i), field(8, i), field(9, i));
+}
+
+vec4 getLight(int l) // position and intensity
+{
+    return vec4(texelFetch(lights, l).r,
+                texelFetch(lights, lightStride + l).r,
+                texelFetch(lights, 2 * lightStride + l).r,
+                texelFetch(lights, 3 * lightStride + l).r);
+}
+
 float intersect(vec3 o, vec3 dir, int i)
 {
-    vec3 dv = o - spheres[i].xyz;
-    float sqrr = spheres[i].w * spheres[i].w;
+    vec4 sp = getSphere(i);
+    vec3 dv = o - sp.xyz;
+    float sqrr = sp.w * sp.w;
     float delta = dot(dir, dv);
     delta *= delta;
     delta += -dot(dv, dv) + sqrr;
@@ -54,6 +126,152 @@ float intersect(vec3 o, vec3 dir, int i)
         return -1.0f;
 }
 
+// 1 / d, kept finite so that 0 * inf never turns a box test into NaN
+vec3 invDir(vec3 d)
+{
+    vec3 s = vec3(d.x < 0 ? -1.0f : 1.0f, d.y < 0 ? -1.0f : 1.0f, d.z < 0 ? -1.0f : 1.0f);
+    return 1.0f / (s * max(abs(d), vec3(1e-20)));
+}
+
+// whether the ray enters the box somewhere in [0, tmax]
+bool hitBox(vec3 bmin, vec3 bmax, vec3 o, vec3 inv, float tmax)
+{
+    vec3 t0 = (bmin - o) * inv;
+    vec3 t1 = (bmax - o) * inv;
+    vec3 tn = min(t0, t1);
+    vec3 tf = max(t0, t1);
+    float near = max(max(tn.x, tn.y), tn.z);
+    float far = min(min(tf.x, tf.y), tf.z);
+    return far >= max(near, 0.0f) && near <= tmax;
+}
+
+// closest sphere but skip along the ray, -1 if none (d is then untouched)
+int closestHit(vec3 o, vec3 dir, int skip, inout float d)
+{
+    int best = -1;
+
+    if (bvhSize == 0)
+    {
+        for (int i = 0; i < objNb; ++i)
+        {
+            if (i == skip)
+                continue;
+            float d_ = intersect(o, dir, i);
+            if (d_ > 0 && d_ < d)
+            {
+                d = d_;
+                best = i;
+            }
+        }
+        return best;
+    }
+
+    // stackless walk: next node on a hit, escape on a miss
+    vec3 inv = invDir(dir);
+    int n = 0;
+    while (n < bvhSize)
+    {
+        vec4 lo = texelFetch(bvhNodes, 2 * n);
+        vec4 hi = texelFetch(bvhNodes, 2 * n + 1);
+        int index = int(lo.w);
+        int count = int(hi.w);
+
+        if (!hitBox(lo.xyz, hi.xyz, o, inv, d))
+        {
+            n = count > 0 ? n + 1 : index;
+            continue;
+        }
+
+        for (int k = index; k < index + count; ++k)
+        {
+            int i = texelFetch(bvhPrims, k).r;
+            if (i == skip)
+                continue;
+            float d_ = intersect(o, dir, i);
+            // the lowest index wins on a tie, as in the linear loop
+            if (d_ > 0 && (d_ < d || (d_ == d && i < best)))
+            {
+                d = d_;
+                best = i;
+            }
+        }
+        ++n;
+    }
+    return best;
+}
+
+// closestHit() of the pixel's ray, among the spheres of its tile
+int primaryHit(vec3 o, vec3 dir, inout float d)
+{
+    if (bvhSize != 0 || screenTile == 0)
+        return closestHit(o, dir, -1, d);
+
+    int t = int(gl_FragCoord.y) / screenTile * tilesX + int(gl_FragCoord.x) / screenTile;
+    int best = -1;
+    int end = texelFetch(tileSpheres, t + 1).r;
+    // in index order, the lowest index still winning on a tie
+    for (int k = texelFetch(tileSpheres, t).r; k < end; ++k)
+    {
+        int i = texelFetch(tileSpheres, k).r;
+        float d_ = intersect(o, dir, i);
+        if (d_ > 0 && d_ < d)
+        {
+            d = d_;
+            best = i;
+        }
+    }
+    return best;
+}
+
+// whether any sphere but skip is along the ray toward light l
+bool anyHit(vec3 o, vec3 dir, int skip, int l)
+{
+    if (bvhSize == 0 && occluderLists != 0)
+    {
+        int end = texelFetch(occluders, l + 1).r;
+        for (int k = texelFetch(occluders, l).r; k < end; ++k)
+        {
+            int i = texelFetch(occluders, k).r;
+            if (i != skip && intersect(o, dir, i) > 0)
+                return true;
+        }
+        return false;
+    }
+
+    if (bvhSize == 0)
+    {
+        for (int k = 0; k < objNb; ++k)
+            if (k != skip && intersect(o, dir, k) > 0)
+                return true;
+        return false;
+    }
+
+    vec3 inv = invDir(dir);
+    int n = 0;
+    while (n < bvhSize)
+    {
+        vec4 lo = texelFetch(bvhNodes, 2 * n);
+        vec4 hi = texelFetch(bvhNodes, 2 * n + 1);
+        int index = int(lo.w);
+        int count = int(hi.w);
+
+        if (!hitBox(lo.xyz, hi.xyz, o, inv, 1e30))
+        {
+            n = count > 0 ? n + 1 : index;
+            continue;
+        }
+
+        for (int k = index; k < index + count; ++k)
+        {
+            int i = texelFetch(bvhPrims, k).r;
+            if (i != skip && intersect(o, dir, i) > 0)
+                return true;
+        }
+        ++n;
+    }
+    return false;
+}
+
 vec3 reflect(vec3 a, vec3 dir, vec3 n)
 {
     if (dot(dir, n) > 0)
@@ -67,37 +285,28 @@ vec3 compColor(vec3 a, vec3 dir, vec3 inter, vec3 normal, vec3 s, int i)
     vec3 color = vec3(0,0,0);
 
     /*
-      kd = attr[i].x;
-      ks = attr[i].y;
-      phong = attr[i].z;
+      kd = getAttr(i).x;
+      ks = getAttr(i).y;
+      phong = getAttr(i).z;
      */
+    vec3 at = getAttr(i);
+    vec3 col = getColor(i);
 
     for (int l = 0; l < lNb; ++l)
     {
-        vec3 lDir = normalize(inter - lights[l].xyz);
+        vec4 light = getLight(l);
+        vec3 lDir = normalize(inter - light.xyz);
 
         // compute shadow
-        bool visible = true;
-        for (int k = 0; k < objNb; ++k)
-        {
-            if (k == i)
-                continue;
-            float d = intersect(inter, -lDir, k);
-            if (d > 0)
-            {
-                visible = false;
-                k = objNb + 1; // break
-            }
-        }
-        if (visible)
+        if (!anyHit(inter, -lDir, i, l))
         {
             // compute diffusion
             float NdotL = max(dot(normal, lDir), 0.0f);
-            color += attr[i].x * lights[l].w * colors[i] * NdotL;
+            color += at.x * light.w * col * NdotL;
 
             // compute specularity
             float SdotL = max(dot(s, lDir), 0.0f);
-            color += attr[i].y * lights[l].w * colors[i] * pow(SdotL, attr[i].z);
+            color += at.y * light.w * col * pow(SdotL, at.z);
         }
     }
 
@@ -116,7 +325,7 @@ vec3 compColor(vec3 a, vec3 dir, vec3 inter, vec3 normal, vec3 s, int i)
         color.b = 0;
 
     // ambient lighting
-    color += ambientLight * colors[i];
+    color += ambientLight * col;
 
     return color;
 }
@@ -126,27 +335,19 @@ vec3 castRay(vec3 a_, vec3 dir_)
     float attenuationLimit = 10000;
 
     int curObj = -1;
-    vec3 color = vec3(0f, 0f, 0f);
+    vec3 color = vec3(0.0f, 0.0f, 0.0f);
 
     vec3 a = a_;
     vec3 dir = dir_;
     float attenuation = 0;
 
-    while (attenuation < attenuationLimit)
+    for (int bounce = 0; maxBounces < 0 || bounce <= maxBounces; ++bounce)
     {
+        if (attenuation >= attenuationLimit)
+            break;
+
         float d = 1e30;
-        int o = -1;
-        for (int i = 0; i < objNb; ++i)
-        {
-            if (i == curObj)
-                continue;
-            float d_ = intersect(a, dir, i);
-            if (d_ > 0 && d_ < d)
-            {
-                d = d_;
-                o = i;
-            }
-        }
+        int o = bounce == 0 ? primaryHit(a, dir, d) : closestHit(a, dir, curObj, d);
 
         if (o >= 0)
         {
@@ -157,15 +358,15 @@ vec3 castRay(vec3 a_, vec3 dir_)
             // intersection point
             vec3 inter = a + d * dir;
             // object's normal at the intersection
-            vec3 n = normalize(inter - spheres[o].xyz);
+            vec3 n = normalize(inter - getSphere(o).xyz);
             // reflected ray
             vec3 s = reflect(a, dir, n);
 
             if (curObj == -1)
                 color = compColor(a, dir, inter, n, s, o);
             else
-                color += attr[curObj].y * compColor(a, dir, inter, n, s, o);
-            if (attr[o].y == 0)
+                color += getAttr(curObj).y * compColor(a, dir, inter, n, s, o);
+            if (getAttr(o).y == 0)
                 break;
             else
             {
@@ -188,5 +389,5 @@ void main()
     vec3 a = origin + p.x * u + p.y * v;
     vec3 dir = normalize(a - (origin - (focal * normal)));
 
-    vertexColor = vec4(castRay(a, dir), 1f);
+    vertexColor = vec4(castRay(a, dir), 1.0f);
 }
@@ -0,0 +1,86 @@
+#include "audioclock.hpp"
+#include <algorithm>
+#include <cmath>
+
+// loop gains, per update: part of the error taken into the phase, and into
+// the rate (per ms of error)
+#define PHASE_GAIN      .05
+#define RATE_GAIN       .00002
+// the rate stays within this of the nominal one
+#define MAX_RATE_ERROR  .05
+// phase correction per update, as a part of the time elapsed
+#define MAX_SLEW        .1
+
+AudioClock::AudioClock(double rate)
+    : nominal_(rate), rate_(rate), wall_(0), estimate_(0), output_(0), audio_(-1), audioWall_(0),
+      stuck_(false), started_(false), stats_()
+{
+}
+
+double AudioClock::update(double now, double audioMs)
+{
+    if (!started_)
+    {
+        started_ = true;
+        wall_ = audioWall_ = now;
+        estimate_ = output_ = std::max(audioMs, 0.0);
+        audio_ = audioMs;
+        return output_;
+    }
+
+    double dt = (now - wall_) * 1e3;
+    wall_ = now;
+    estimate_ += rate_ * dt;
+    ++stats_.updates;
+
+    if (audioMs >= 0)
+    {
+        // stuck while playing: an underrun, counted once it lasts
+        if (audioMs != audio_)
+        {
+            if (stuck_)
+                stats_.gapTime += (now - audioWall_) * 1e3;
+            stuck_ = false;
+            audio_ = audioMs;
+            audioWall_ = now;
+        }
+        else if (!stuck_ && (now - audioWall_) * 1e3 > GAP_MS)
+        {
+            stuck_ = true;
+            ++stats_.gaps;
+        }
+
+        double error = audioMs - estimate_;
+        stats_.error = error;
+        stats_.errorMax = std::max(stats_.errorMax, fabs(error));
+
+        if (fabs(error) > RESYNC_MS)
+        {
+            estimate_ = audioMs;
+            rate_ = nominal_;
+            ++stats_.resyncs;
+        }
+        else if (!stuck_)
+        {
+            double slew = MAX_SLEW * dt;
+            double phase = std::min(std::max(PHASE_GAIN * error, -slew), slew);
+            estimate_ += phase;
+            stats_.correction += fabs(phase);
+
+            rate_ += RATE_GAIN * error;
+            rate_ = std::min(std::max(rate_, nominal_ * (1 - MAX_RATE_ERROR)), nominal_ * (1 + MAX_RATE_ERROR));
+        }
+    }
+
+    output_ = std::max(output_, estimate_);
+    stats_.rate = rate_;
+    return output_;
+}
+
+AudioClockStats AudioClock::takeStats()
+{
+    AudioClockStats s = stats_;
+    stats_ = AudioClockStats();
+    stats_.rate = rate_;
+    return s;
+}
@@ -0,0 +1,64 @@
+#ifndef AUDIOCLOCK_HPP
+#define AUDIOCLOCK_HPP
+
+/*
+  Timeline time taken from the music.
+
+  The position sf::Music reports moves in steps (buffers queued to OpenAL)
+  and jitters with its streaming thread, so it is not used as is: a
+  phase-locked loop follows it with a time that runs at its own rate
+  between two readings. Each reading nudges both the phase (a fraction of
+  the error, bounded per frame so that the animation never visibly jumps)
+  and the rate (an integral of the error, bounded to a few percent of the
+  nominal one). The time never goes back.
+
+  An error beyond RESYNC_MS (a seek, a long hitch) is not slewed away: the
+  clock jumps forward, or waits for the music if it is ahead. A reading
+  that did not move for GAP_MS of wall time while the music plays is an
+  underrun, counted with its length. Without music (none, or it ended) the
+  clock runs on at its last rate.
+*/
+
+#define RESYNC_MS       200.0
+#define GAP_MS          50.0
+
+struct AudioClockStats
+{
+    unsigned updates;
+    unsigned resyncs;
+    unsigned gaps;          // underruns
+    double gapTime;         // ms of wall time the music was stuck
+    double error;           // ms, last reading minus the clock before correction
+    double errorMax;        // ms, absolute
+    double correction;      // ms of phase applied, absolute, summed
+    double rate;            // music ms per wall ms, now
+};
+
+class AudioClock
+{
+public:
+    // music playing `rate` times faster than the wall clock
+    explicit AudioClock(double rate = 1);
+
+    // the timeline time (ms) at wall time `now` (s), the music being at
+    // `audioMs` if playing, negative if not
+    double update(double now, double audioMs);
+
+    double time() const { return output_; }
+    // since the last call, rate and error being the latest
+    AudioClockStats takeStats();
+
+private:
+    double nominal_;
+    double rate_;
+    double wall_;       // s, last update
+    double estimate_;   // ms at wall_
+    double output_;     // ms, last returned
+    double audio_;      // last reading
+    double audioWall_;  // s, when it last moved
+    bool stuck_;
+    bool started_;
+    AudioClockStats stats_;
+};
+
+#endif
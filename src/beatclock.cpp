@@ -0,0 +1,84 @@
+#include "beatclock.hpp"
+#include <cmath>
+
+BeatClock::BeatClock(double bpm, double offset)
+    : offset_(offset)
+{
+    tempi_.push_back(Tempo{0, offset, bpm});
+}
+
+void BeatClock::setTempo(double beat, double bpm)
+{
+    // before beat 0 the first tempo applies, the change is made from it
+    if (beat < 0)
+        beat = 0;
+
+    unsigned i = 0;
+    while (i < tempi_.size() && tempi_[i].beat < beat)
+        ++i;
+    if (i < tempi_.size() && tempi_[i].beat == beat)
+        tempi_[i].bpm = bpm;
+    else
+        tempi_.insert(tempi_.begin() + i, Tempo{beat, 0, bpm});
+    retime();
+}
+
+void BeatClock::setOffset(double offset)
+{
+    offset_ = offset;
+    retime();
+}
+
+void BeatClock::retime()
+{
+    tempi_[0].time = offset_;
+    for (unsigned i = 1; i < tempi_.size(); ++i)
+    {
+        const Tempo& t = tempi_[i - 1];
+        tempi_[i].time = t.time + (tempi_[i].beat - t.beat) * 60000 / t.bpm;
+    }
+}
+
+/*
+  A show has a handful of tempo changes, a linear search over them is
+  cheaper than anything smarter.
+*/
+
+const BeatClock::Tempo& BeatClock::atTime(double T) const
+{
+    unsigned i = 0;
+    while (i + 1 < tempi_.size() && tempi_[i + 1].time <= T)
+        ++i;
+    return tempi_[i];
+}
+
+const BeatClock::Tempo& BeatClock::atBeat(double beat) const
+{
+    unsigned i = 0;
+    while (i + 1 < tempi_.size() && tempi_[i + 1].beat <= beat)
+        ++i;
+    return tempi_[i];
+}
+
+double BeatClock::beat(double T) const
+{
+    const Tempo& t = atTime(T);
+    return t.beat + (T - t.time) * t.bpm / 60000;
+}
+
+double BeatClock::time(double beat) const
+{
+    const Tempo& t = atBeat(beat);
+    return t.time + (beat - t.beat) * 60000 / t.bpm;
+}
+
+double BeatClock::bpm(double T) const
+{
+    return atTime(T).bpm;
+}
+
+double BeatClock::phase(double T, double division) const
+{
+    double b = beat(T) * division;
+    return b - std::floor(b);
+}
@@ -0,0 +1,54 @@
+#ifndef BEATCLOCK_HPP
+#define BEATCLOCK_HPP
+
+#include <vector>
+
+/*
+  Where the music is in beats, from its time.
+
+  A tempo map: beat 0 is `offset` ms into the music, then the tempo holds
+  until the next change, each one starting on a beat (possibly a fraction
+  of one). Beats and phases are computed from the time, not found by
+  watching a signal between frames, so a late frame neither misses a beat
+  nor counts one twice, and any time can be asked in any order.
+*/
+
+class BeatClock
+{
+public:
+    explicit BeatClock(double bpm = 120, double offset = 0);
+
+    // the tempo from `beat` on; later changes are kept (their times move)
+    void setTempo(double beat, double bpm);
+    // ms of music of beat 0
+    void setOffset(double offset);
+
+    // beats since beat 0 at T (ms), fractional, negative before it
+    double beat(double T) const;
+    // ms of music of `beat`
+    double time(double beat) const;
+    // tempo at T
+    double bpm(double T) const;
+
+    // position in [0, 1) within the 1/division of a beat T falls in
+    // (division 2 for half beats, .25 for bars of 4)
+    double phase(double T, double division = 1) const;
+
+private:
+    struct Tempo
+    {
+        double beat;
+        double time;    // ms, of beat
+        double bpm;
+    };
+
+    // the change in effect at T, or at beat
+    const Tempo& atTime(double T) const;
+    const Tempo& atBeat(double beat) const;
+    void retime();
+
+    double offset_;
+    std::vector<Tempo> tempi_;  // by beat, the first one at beat 0
+};
+
+#endif
@@ -0,0 +1,987 @@
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <thread>
+#include <vector>
+#include "vec.hpp"
+#include "intersect.hpp"
+#include "scene.hpp"
+#include "raytracer.hpp"
+#include "tiles.hpp"
+#include "wavefront.hpp"
+#include "screentiles.hpp"
+#include "bvh.hpp"
+#include "audioclock.hpp"
+#include "timeline.hpp"
+
+/*
+  Microbenchmarks of the CPU path, no window nor GL needed.
+
+    $ make bench
+    $ ./bench [section...]
+*/
+
+/***********/
+/* HELPERS */
+/***********/
+
+static double now()
+{
+    using namespace std::chrono;
+    return duration<double>(steady_clock::now().time_since_epoch()).count();
+}
+
+static float randf(float a, float b)
+{
+    return a + (b - a) * (rand() / float(RAND_MAX));
+}
+
+// n spheres scattered in a 4000 units cube, the size of the demo's ring
+struct RandomSpheres
+{
+    std::vector<float> x, y, z, r;
+
+    RandomSpheres(int n) : x(n), y(n), z(n), r(n)
+    {
+        for (int i = 0; i < n; ++i)
+        {
+            x[i] = randf(-2000, 2000);
+            y[i] = randf(-2000, 2000);
+            z[i] = randf(-2000, 2000);
+            r[i] = randf(50, 300);
+        }
+    }
+
+    SphereColumns columns() const
+    {
+        SphereColumns c = {x.data(), y.data(), z.data(), r.data(), int(x.size())};
+        return c;
+    }
+};
+
+// n rays shot from the demo's camera toward the scene
+struct RandomRays
+{
+    std::vector<float> ox, oy, oz, dx, dy, dz;
+
+    RandomRays(int n) : ox(n), oy(n), oz(n), dx(n), dy(n), dz(n)
+    {
+        for (int i = 0; i < n; ++i)
+        {
+            vec3 o = {randf(-400, 400), randf(-300, 300), -4000};
+            vec3 d = normalize(vec3{randf(-2000, 2000), randf(-2000, 2000), 0} - o);
+            ox[i] = o.x; oy[i] = o.y; oz[i] = o.z;
+            dx[i] = d.x; dy[i] = d.y; dz[i] = d.z;
+        }
+    }
+
+    vec3 origin(int i) const { return vec3{ox[i], oy[i], oz[i]}; }
+    vec3 dir(int i) const { return vec3{dx[i], dy[i], dz[i]}; }
+
+    RayColumns columns() const
+    {
+        RayColumns c = {ox.data(), oy.data(), oz.data(), dx.data(), dy.data(), dz.data()};
+        return c;
+    }
+};
+
+// the first scene of the demo: a big mirror sphere in a ring of 18
+static void ringScene(SceneStore& scene, Scene& sc)
+{
+    scene.resizeLights(1);
+    scene.setLight(0, {0,0,-4000, 1.0});
+    scene.resize(19);
+    scene.setSphere(0, {0,0,0, 1000}, {.6, .6, .6}, {.8, 1.0, 16});
+    for (int i = 0; i < 18; ++i)
+    {
+        float c = cos(i * 20 * M_PI / 180);
+        float s = sin(i * 20 * M_PI / 180);
+        scene.setSphere(i+1, {1400 * c, 0, 1400 * s, 100}, {1,1,0}, {.7,.5,16});
+    }
+
+    // what getCamera() gives for a camera at (0,0,-4000) looking at 0
+    sc.resolution = {800, 600};
+    sc.origin = {0, 0, -4000};
+    sc.normal = {0, 0, 1};
+    sc.u = {-1, 0, 0};
+    sc.v = {0, 1, 0};
+    sc.focal = 800 / (2.0 * 0.41421356237309503);
+    sc.store = &scene;
+    sc.bvh = NULL;
+    sc.occluders = NULL;
+    sc.screenTiles = NULL;
+    sc.maxBounces = -1;
+    sc.ambientLight = .5;
+}
+
+static void report(const char* what, SimdLevel level, double rays, double secs)
+{
+    std::cout << "  " << what << " [" << simdLevelName(level) << "]: "
+              << rays / secs / 1e6 << " Mrays/s\n";
+}
+
+/*************/
+/* INTERSECT */
+/*************/
+
+static void benchIntersect()
+{
+    std::cout << "intersect: closest hit, one ray against n spheres\n";
+
+    const int raysNb = 1 << 14;
+    RandomRays rays(raysNb);
+    int levels = detectSimdLevel();
+
+    for (int n : {19, 100, 1000})
+    {
+        RandomSpheres spheres(n);
+        SphereColumns s = spheres.columns();
+        int rounds = std::max(1, 2000000 / n / raysNb * 8);
+
+        // reference: the GLSL loop as is
+        std::vector<int> ref(raysNb);
+        double t = now();
+        for (int k = 0; k < rounds; ++k)
+            for (int i = 0; i < raysNb; ++i)
+            {
+                float d = 1e30;
+                int o = -1;
+                for (int j = 0; j < n; ++j)
+                {
+                    float d_ = intersectSphere(rays.origin(i), rays.dir(i), s.x[j], s.y[j], s.z[j], s.r[j]);
+                    if (d_ > 0 && d_ < d)
+                    {
+                        d = d_;
+                        o = j;
+                    }
+                }
+                ref[i] = o;
+            }
+        std::cout << " n = " << n << "\n";
+        report("glsl loop", SIMD_SCALAR, double(rounds) * raysNb, now() - t);
+
+        for (int l = SIMD_SCALAR; l <= levels; ++l)
+        {
+            setSimdLevel(SimdLevel(l));
+            int mismatches = 0;
+            t = now();
+            for (int k = 0; k < rounds; ++k)
+                for (int i = 0; i < raysNb; ++i)
+                {
+                    float d = 1e30;
+                    mismatches += closestHit(rays.origin(i), rays.dir(i), s, -1, d) != ref[i];
+                }
+            report("closestHit", SimdLevel(l), double(rounds) * raysNb, now() - t);
+            if (mismatches)
+                std::cout << "  MISMATCHES: " << mismatches << "\n";
+        }
+    }
+
+    std::cout << "intersect: packet, n rays against one sphere\n";
+
+    const int packetNb = 1 << 20;
+    RandomRays packet(packetNb);
+    RayColumns r = packet.columns();
+    vec4 sphere = {0, 0, 0, 1000};
+    std::vector<float> ref(packetNb), d(packetNb);
+
+    setSimdLevel(SIMD_SCALAR);
+    intersectPacket(r, packetNb, sphere, ref.data());
+
+    for (int l = SIMD_SCALAR; l <= levels; ++l)
+    {
+        setSimdLevel(SimdLevel(l));
+        int rounds = 20;
+        double t = now();
+        for (int k = 0; k < rounds; ++k)
+            intersectPacket(r, packetNb, sphere, d.data());
+        report("intersectPacket", SimdLevel(l), double(rounds) * packetNb, now() - t);
+        if (memcmp(d.data(), ref.data(), packetNb * sizeof(float)))
+            std::cout << "  MISMATCHES\n";
+    }
+
+    setSimdLevel(SimdLevel(levels));
+}
+
+/*********/
+/* SCENE */
+/*********/
+
+static void benchScene()
+{
+    std::cout << "scene: ring animation step (rotate x, z of every sphere)\n";
+
+    const int n = 1 << 16, rounds = 2000;
+    const float ca = cosf(.01f), sa = sinf(.01f);
+    std::vector<vec4> aos(n);
+    SceneStore soa;
+    soa.resize(n);
+    for (int i = 0; i < n; ++i)
+    {
+        aos[i] = {1400 * cosf(i), 0, 1400 * sinf(i), 100};
+        soa.setSphere(i, aos[i]);
+    }
+
+    double t = now();
+    for (int k = 0; k < rounds; ++k)
+        for (int i = 0; i < n; ++i)
+        {
+            float x = aos[i].x, z = aos[i].z;
+            aos[i].x = x * ca - z * sa;
+            aos[i].z = x * sa + z * ca;
+        }
+    double aosTime = now() - t;
+
+    t = now();
+    for (int k = 0; k < rounds; ++k)
+    {
+        float* x = soa.column(SceneStore::X);
+        float* z = soa.column(SceneStore::Z);
+        for (int i = 0; i < n; ++i)
+        {
+            float x_ = x[i], z_ = z[i];
+            x[i] = x_ * ca - z_ * sa;
+            z[i] = x_ * sa + z_ * ca;
+        }
+    }
+    double soaTime = now() - t;
+
+    std::cout << "  vec4 array: " << aosTime / rounds * 1e6 << " us per step\n"
+              << "  SceneStore: " << soaTime / rounds * 1e6 << " us per step\n";
+}
+
+/*******/
+/* BVH */
+/*******/
+
+static void benchBvh()
+{
+    std::cout << "bvh: closest hit and any hit, BVH against brute force\n";
+
+    const int raysNb = 1 << 14;
+    RandomRays rays(raysNb);
+    SimdLevel level = simdLevel();
+
+    for (int n : {19, 100, 1000, 10000})
+    {
+        // radii shrink with n, so that the cube stays as crowded as with 19
+        RandomSpheres spheres(n);
+        SceneStore scene;
+        scene.resize(n);
+        for (int i = 0; i < n; ++i)
+            scene.setSphere(i, {spheres.x[i], spheres.y[i], spheres.z[i], spheres.r[i] / cbrtf(n / 19.0f)});
+        SphereColumns s = scene.sphereColumns();
+
+        Bvh bvh;
+        int builds = std::max(1, 100000 / n);
+        double t = now();
+        for (int k = 0; k < builds; ++k)
+            bvh.build(scene);
+        t = (now() - t) / builds;
+        std::cout << " n = " << n << "\n  build: " << t * 1e3 << " ms, " << bvh.nodes().size()
+                  << " nodes, SAH cost " << bvh.cost() << "\n";
+
+        int rounds = std::max(1, 2000000 / n / raysNb * 8);
+        std::vector<int> ref(raysNb);
+        std::vector<float> refD(raysNb);
+        std::vector<char> refAny(raysNb);
+        t = now();
+        for (int k = 0; k < rounds; ++k)
+            for (int i = 0; i < raysNb; ++i)
+            {
+                refD[i] = 1e30;
+                ref[i] = closestHit(rays.origin(i), rays.dir(i), s, -1, refD[i]);
+            }
+        report("closestHit", level, double(rounds) * raysNb, now() - t);
+
+        int mismatches = 0;
+        t = now();
+        for (int k = 0; k < rounds; ++k)
+            for (int i = 0; i < raysNb; ++i)
+            {
+                float d = 1e30;
+                int o = bvh.closestHit(rays.origin(i), rays.dir(i), s, -1, d);
+                mismatches += o != ref[i] || d != refD[i];
+            }
+        report("bvh closestHit", SIMD_SCALAR, double(rounds) * raysNb, now() - t);
+
+        t = now();
+        for (int k = 0; k < rounds; ++k)
+            for (int i = 0; i < raysNb; ++i)
+                refAny[i] = anyHit(rays.origin(i), rays.dir(i), s, 0);
+        report("anyHit", level, double(rounds) * raysNb, now() - t);
+
+        t = now();
+        for (int k = 0; k < rounds; ++k)
+            for (int i = 0; i < raysNb; ++i)
+                mismatches += bvh.anyHit(rays.origin(i), rays.dir(i), s, 0) != refAny[i];
+        report("bvh anyHit", SIMD_SCALAR, double(rounds) * raysNb, now() - t);
+
+        if (mismatches)
+            std::cout << "  MISMATCHES: " << mismatches << "\n";
+    }
+}
+
+/*********/
+/* REFIT */
+/*********/
+
+// n spheres on rings around y, the outer rings turning slower
+static void ringStep(SceneStore& scene, int n, float t)
+{
+    float* x = scene.column(SceneStore::X);
+    float* z = scene.column(SceneStore::Z);
+    for (int i = 0; i < n; ++i)
+    {
+        int ring = i % 20;
+        float radius = 1400 + 100 * ring;
+        float a = i * 2 * M_PI * 20 / n + t / (1 + ring);
+        x[i] = radius * cosf(a);
+        z[i] = radius * sinf(a);
+    }
+}
+
+static void benchRefit()
+{
+    std::cout << "refit: rings turning at different speeds, 200 steps\n";
+
+    const int steps = 200, raysNb = 1 << 12;
+    RandomRays rays(raysNb);
+
+    for (int n : {1000, 10000})
+    {
+        SceneStore scene;
+        scene.resize(n);
+        for (int i = 0; i < n; ++i)
+            scene.setSphere(i, {0, randf(-300, 300), 0, 20});
+        ringStep(scene, n, 0);
+
+        Bvh bvh;
+        bvh.build(scene);
+        Bvh fresh;
+        double refitTime = 0, buildTime = 0;
+        int builds = 0, mismatches = 0;
+        for (int k = 1; k <= steps; ++k)
+        {
+            ringStep(scene, n, k * .02f);
+            double t = now();
+            builds += bvh.update(scene);
+            refitTime += now() - t;
+            t = now();
+            fresh.build(scene);
+            buildTime += now() - t;
+
+            SphereColumns s = scene.sphereColumns();
+            for (int i = 0; i < raysNb; i += 16)
+            {
+                float d = 1e30, d_ = 1e30;
+                mismatches += bvh.closestHit(rays.origin(i), rays.dir(i), s, -1, d)
+                    != closestHit(rays.origin(i), rays.dir(i), s, -1, d_) || d != d_;
+            }
+        }
+
+        std::cout << " n = " << n << "\n  update: " << refitTime / steps * 1e3 << " ms per step, "
+                  << builds << " rebuilds, cost " << bvh.cost() << " (" << bvh.buildCost()
+                  << " when built)\n  build: " << buildTime / steps * 1e3 << " ms per step, cost "
+                  << fresh.cost() << "\n";
+
+        SphereColumns s = scene.sphereColumns();
+        for (Bvh* b : {&bvh, &fresh})
+        {
+            double t = now();
+            for (int i = 0; i < raysNb; ++i)
+            {
+                float d = 1e30;
+                b->closestHit(rays.origin(i), rays.dir(i), s, -1, d);
+            }
+            report(b == &bvh ? "updated closestHit" : "built closestHit", SIMD_SCALAR, raysNb, now() - t);
+        }
+        if (mismatches)
+            std::cout << "  MISMATCHES: " << mismatches << "\n";
+    }
+}
+
+/**********/
+/* RENDER */
+/**********/
+
+static void benchRender()
+{
+    std::cout << "render: first scene of the demo, 800x600\n";
+
+    SceneStore scene;
+    Scene sc;
+    ringScene(scene, sc);
+    Framebuffer fb;
+
+    unsigned cores = std::max(std::thread::hardware_concurrency(), 1u);
+    double single = 0;
+    for (unsigned threads = 1; threads <= std::max(cores, 4u); threads *= 2)
+    {
+        const int frames = 5;
+        TileRenderer renderer(threads);
+        renderer.render(sc, fb);
+        renderer.takeStats();
+
+        double t = now();
+        for (int k = 0; k < frames; ++k)
+            renderer.render(sc, fb);
+        t = (now() - t) / frames;
+        if (threads == 1)
+            single = t;
+
+        // how evenly the work was shared: the least busy worker, and idle time
+        TileStats s = renderer.takeStats();
+        double busy = 0, least = s.time, idle = 0;
+        unsigned steals = 0;
+        for (const TileWorkerStats& w : s.workers)
+        {
+            busy += w.busy;
+            least = std::min(least, w.busy);
+            idle += w.idle;
+            steals += w.steals;
+        }
+        std::cout << "  " << threads << " threads: " << t * 1e3 << " ms per frame, x" << single / t
+                  << (threads > cores ? " (more threads than cores)" : "") << ", "
+                  << s.tileSize << "px tiles, " << 100 * idle / (busy + idle) << "% idle, least busy worker "
+                  << 100 * least / s.time << "% of the time, " << steals / s.frames << " steals per frame\n";
+    }
+}
+
+/*************/
+/* TRAVERSAL */
+/*************/
+
+static void benchTraversal()
+{
+    std::cout << "traversal: 2000 spheres through the BVH, 800x600, one thread\n";
+
+    SceneStore scene;
+    Scene sc;
+    ringScene(scene, sc);
+    RandomSpheres spheres(2000);
+    scene.resize(2000);
+    for (int i = 1; i < 2000; ++i)
+        scene.setSphere(i, {spheres.x[i], spheres.y[i], spheres.z[i], 40}, {1, 1, 0},
+                        {.7, i % 3 ? 0.0f : .5f, 16});
+    Bvh bvh;
+    bvh.build(scene);
+    sc.bvh = &bvh;
+
+    Framebuffer ref;
+    renderFrame(sc, ref, 1);
+
+    for (int order = 0; order < ORDERS; ++order)
+        for (unsigned packet : {1u, 16u})
+        {
+            TileWalk walk;
+            walk.order = PixelOrder(order);
+            walk.packet = packet;
+            TileRenderer renderer(1);
+            renderer.setWalk(walk);
+            Framebuffer fb;
+            renderer.render(sc, fb);
+            renderer.takeStats();
+
+            const int frames = 2;
+            double t = now();
+            for (int k = 0; k < frames; ++k)
+                renderer.render(sc, fb);
+            t = (now() - t) / frames;
+
+            const TileWorkerStats& w = renderer.takeStats().workers[0];
+            std::cout << "  " << pixelOrderName(walk.order) << ", packets of " << packet << ": " << t * 1e3
+                      << " ms, per ray " << double(w.rays.nodes) / w.rays.rays << " nodes "
+                      << double(w.rays.spheres) / w.rays.rays << " spheres, primary "
+                      << double(w.primary.nodes) / w.primary.rays << " nodes "
+                      << double(w.primary.spheres) / w.primary.rays << " spheres"
+                      << (fb.pixels == ref.pixels ? "" : ", PIXELS DIFFER") << "\n";
+        }
+}
+
+/*************/
+/* WAVEFRONT */
+/*************/
+
+// one frame pixel by pixel then stage by stage, one thread
+static void compareWavefront(const char* what, const Scene& sc)
+{
+    Framebuffer ref, fb;
+    double t[2];
+    WavefrontStats stages = WavefrontStats();
+    for (int wave = 0; wave < 2; ++wave)
+    {
+        TileWalk walk;
+        walk.wavefront = wave;
+        TileRenderer renderer(1);
+        renderer.setWalk(walk);
+        renderer.render(sc, wave ? fb : ref);
+        renderer.takeStats();
+
+        const int frames = 2;
+        t[wave] = now();
+        for (int k = 0; k < frames; ++k)
+            renderer.render(sc, wave ? fb : ref);
+        t[wave] = (now() - t[wave]) / frames;
+        stages = renderer.takeStats().workers[0].stages;
+    }
+
+    std::cout << "  " << what << ": " << t[0] * 1e3 << " ms per pixel, " << t[1] * 1e3 << " ms by stage"
+              << (fb.pixels == ref.pixels ? "" : ", PIXELS DIFFER") << "\n   ";
+    for (int i = 0; i < WAVE_STAGES; ++i)
+        std::cout << " " << waveStageName(WaveStage(i)) << " " << stages.rays[i] / stages.time[i] / 1e6
+                  << " Mrays/s";
+    std::cout << "\n";
+}
+
+static void benchWavefront()
+{
+    std::cout << "wavefront: 800x600, one thread\n";
+
+    SceneStore scene;
+    Scene sc;
+    ringScene(scene, sc);
+    compareWavefront("first scene of the demo", sc);
+
+    RandomSpheres spheres(2000);
+    scene.resize(300);
+    for (int i = 1; i < 300; ++i)
+        scene.setSphere(i, {spheres.x[i], spheres.y[i], spheres.z[i], 40}, {1, 1, 0},
+                        {.7, i % 3 ? 0.0f : .5f, 16});
+    compareWavefront("300 spheres", sc);
+
+    scene.resize(2000);
+    for (int i = 300; i < 2000; ++i)
+        scene.setSphere(i, {spheres.x[i], spheres.y[i], spheres.z[i], 40}, {1, 1, 0},
+                        {.7, i % 3 ? 0.0f : .5f, 16});
+    Bvh bvh;
+    bvh.build(scene);
+    sc.bvh = &bvh;
+    compareWavefront("2000 spheres through the BVH", sc);
+}
+
+/***********/
+/* SHADOWS */
+/***********/
+
+static void benchShadows()
+{
+    std::cout << "shadows: occluder lists, 800x600, one thread\n";
+
+    SceneStore scene;
+    Scene sc;
+    ringScene(scene, sc);
+    // a second light, off the camera, so that shadows show
+    scene.resizeLights(2);
+    scene.setLight(1, {3000, 2000, -1000, .5});
+
+    for (int spheres : {19, 60})
+    {
+        RandomSpheres extra(spheres);
+        scene.resize(spheres);
+        for (int i = 19; i < spheres; ++i)
+            scene.setSphere(i, {extra.x[i], extra.y[i], extra.z[i], 40}, {1, 1, 0}, {.7, 0, 16});
+
+        OccluderLists lists;
+        const int builds = 100;
+        double build = now();
+        for (int k = 0; k < builds; ++k)
+            lists.build(scene);
+        build = (now() - build) / builds;
+
+        Framebuffer ref, fb;
+        double t[2], tested[2];
+        for (int culled = 0; culled < 2; ++culled)
+        {
+            sc.occluders = culled ? &lists : NULL;
+            TileRenderer renderer(1);
+            renderer.render(sc, culled ? fb : ref);
+            // best of a few, the lists saving less than the noise of one frame
+            t[culled] = 1e30;
+            for (int k = 0; k < 3; ++k)
+            {
+                double start = now();
+                renderer.render(sc, culled ? fb : ref);
+                t[culled] = std::min(t[culled], now() - start);
+            }
+            const TileWorkerStats& w = renderer.takeStats().workers[0];
+            tested[culled] = double(w.rays.spheres) / w.rays.rays;
+        }
+        sc.occluders = NULL;
+
+        std::cout << "  " << spheres << " spheres: " << lists.columns(0).n << " and " << lists.columns(1).n
+                  << " candidates for the two lights, built in " << build * 1e3 << " ms; "
+                  << t[0] * 1e3 << " ms and " << tested[0] << " spheres per ray without, "
+                  << t[1] * 1e3 << " ms and " << tested[1] << " with"
+                  << (fb.pixels == ref.pixels ? "" : ", PIXELS DIFFER") << "\n";
+    }
+}
+
+/***********/
+/* CULLING */
+/***********/
+
+// what getCamera() of main.cpp gives for a camera at origin looking at
+// target, drawn at width x height with u and v scaled to the 800x600 window
+// as the dynamic resolution does
+static void lookAt(Scene& sc, const vec3& origin, const vec3& target, float width, float height)
+{
+    vec3 n = normalize(target - origin);
+    vec3 a = {0, 0, 0}, u, v;
+    if (fabs(n.y / n.z) > 1.0)
+    {
+        a.x = 1;
+        v = normalize(cross(a, n));
+        u = normalize(cross(n, v));
+    }
+    else
+    {
+        a.y = 1;
+        u = normalize(cross(n, a));
+        v = normalize(cross(u, n));
+    }
+
+    sc.resolution = {width, height};
+    sc.origin = origin;
+    sc.normal = normalize(cross(v, u));
+    sc.u = (800 / width) * u;
+    sc.v = (600 / height) * v;
+    sc.focal = 800 / (2.0 * 0.41421356237309503);
+}
+
+// every walk, pixel by pixel and by stage, with the tile lists of sc's
+// camera, against the rows without them
+static void compareTiles(const char* what, Scene sc)
+{
+    Framebuffer ref, fb;
+    sc.screenTiles = NULL;
+    TileWalk plain;
+    plain.order = ORDER_ROWS;
+    TileRenderer renderer(1);
+    renderer.setWalk(plain);
+    renderer.render(sc, ref);
+
+    ScreenTiles tiles;
+    tiles.build(sc);
+    sc.screenTiles = &tiles;
+    std::cout << "    " << what << " at " << sc.resolution.x << "x" << sc.resolution.y << ": "
+              << double(tiles.indices().size()) / (tiles.tilesX() * tiles.tilesY()) << " per tile";
+    for (int order = 0; order < ORDERS; ++order)
+        for (int wave = 0; wave < 2; ++wave)
+        {
+            TileWalk walk;
+            walk.order = PixelOrder(order);
+            walk.wavefront = wave;
+            renderer.setWalk(walk);
+            renderer.render(sc, fb);
+            if (fb.pixels != ref.pixels)
+                std::cout << ", PIXELS DIFFER (" << pixelOrderName(walk.order) << (wave ? " by stage)" : ")");
+        }
+    std::cout << "\n";
+}
+
+static void benchCulling()
+{
+    std::cout << "culling: screen tile lists for the primary rays, 800x600, one thread\n";
+
+    SceneStore scene;
+    Scene sc;
+    ringScene(scene, sc);
+
+    for (int spheres : {19, 60})
+    {
+        RandomSpheres extra(spheres);
+        scene.resize(spheres);
+        for (int i = 19; i < spheres; ++i)
+            scene.setSphere(i, {extra.x[i], extra.y[i], extra.z[i], 40}, {1, 1, 0}, {.7, 0, 16});
+
+        ScreenTiles tiles;
+        const int builds = 100;
+        double build = now();
+        for (int k = 0; k < builds; ++k)
+            tiles.build(sc);
+        build = (now() - build) / builds;
+
+        Framebuffer ref, fb;
+        double t[2], tested[2];
+        for (int culled = 0; culled < 2; ++culled)
+        {
+            sc.screenTiles = culled ? &tiles : NULL;
+            TileRenderer renderer(1);
+            renderer.render(sc, culled ? fb : ref);
+            renderer.takeStats();
+            t[culled] = 1e30;
+            for (int k = 0; k < 3; ++k)
+            {
+                double start = now();
+                renderer.render(sc, culled ? fb : ref);
+                t[culled] = std::min(t[culled], now() - start);
+            }
+            const TileWorkerStats& w = renderer.takeStats().workers[0];
+            tested[culled] = double(w.primary.spheres) / w.primary.rays;
+        }
+        sc.screenTiles = NULL;
+
+        std::cout << "  " << spheres << " spheres: " << double(tiles.indices().size()) / (tiles.tilesX() * tiles.tilesY())
+                  << " per tile, built in " << build * 1e3 << " ms; " << t[0] * 1e3 << " ms and " << tested[0]
+                  << " spheres per primary ray without, " << t[1] * 1e3 << " ms and " << tested[1] << " with"
+                  << (fb.pixels == ref.pixels ? "" : ", PIXELS DIFFER") << "\n";
+    }
+
+    // the same pixels, for cameras in and around a crowd of spheres on
+    // screen, some of them mirrors
+    std::cout << "  pixels of all walks, by pixel and by stage, 300 spheres:\n";
+    RandomSpheres extra(300);
+    scene.resize(300);
+    for (int i = 19; i < 300; ++i)
+        scene.setSphere(i, {extra.x[i], extra.y[i], extra.z[i], extra.r[i]}, {1, 1, 0},
+                        {.7, i % 4 ? 0.0f : .5f, 16});
+
+    struct View
+    {
+        const char* name;
+        vec3 origin, target;
+        float width, height;
+    };
+    const View views[] = {
+        {"demo camera", {0, 0, -4000}, {0, 0, 0}, 800, 600},
+        {"demo camera, scaled u and v", {0, 0, -4000}, {0, 0, 0}, 560, 420},
+        {"from a corner", {2500, 1800, -3000}, {0, 0, 0}, 800, 600},
+        {"from above, close", {300, 2600, -500}, {0, 0, 0}, 800, 600},
+        {"eye and screen inside the big sphere", {0, 0, 600}, {0, 0, 2000}, 800, 600},
+        {"eye inside the big sphere, screen out of it", {966, 0, 800}, {3000, 0, 800}, 400, 300},
+    };
+
+    for (const View& view : views)
+    {
+        lookAt(sc, view.origin, view.target, view.width, view.height);
+        compareTiles(view.name, sc);
+    }
+
+    // looking into the crowd from anywhere around it
+    for (int k = 0; k < 6; ++k)
+    {
+        vec3 origin = {randf(-3000, 3000), randf(-3000, 3000), randf(-3000, 3000)};
+        vec3 target = {randf(-1000, 1000), randf(-1000, 1000), randf(-1000, 1000)};
+        float scale = randf(.5, 1);
+        lookAt(sc, origin, target, floor(800 * scale), floor(600 * scale));
+        compareTiles("random camera", sc);
+    }
+}
+
+/*********/
+/* AUDIO */
+/*********/
+
+// position of a music played 0.2% fast at wall time (s), as sf::Music
+// reports it: in 5 ms steps, read up to 2 ms early or late; it stalls for
+// 300 ms at 5 s (an underrun, then a resync) and is seeked 1 s ahead at
+// 12 s (a resync)
+static double musicAt(double wall)
+{
+    double t = wall + randf(-2e-3, 2e-3);
+    double ms = 1.002 * t * 1e3;
+    if (t > 5.3)
+        ms -= 1.002 * 300;
+    else if (t > 5)
+        ms = 1.002 * 5000;
+    if (t > 12)
+        ms += 1000;
+    return floor(ms / 5) * 5;
+}
+
+static void benchAudio()
+{
+    std::cout << "audio: clock following a music stream 0.2% fast, 20 s at 60 fps\n";
+
+    AudioClock clock;
+    double sum = 0, after = 0;
+    unsigned samples = 0;
+    for (int frame = 0; frame <= 20 * 60; ++frame)
+    {
+        double wall = frame / 60.0;
+        double T = clock.update(wall, musicAt(wall));
+
+        // settled: locked, before the stall or long after the seek; and
+        // the worst once resynced after the stall
+        double t = wall > 5.3 ? wall - .3 : wall;
+        double error = T - (1.002 * t * 1e3 + (wall > 12 ? 1000 : 0));
+        if ((wall >= 2 && wall < 4.9) || wall >= 15)
+        {
+            sum += error * error;
+            ++samples;
+        }
+        else if (wall >= 7 && wall < 11.9)
+            after = std::max(after, fabs(error));
+    }
+
+    AudioClockStats s = clock.takeStats();
+    std::cout << "  tracking " << sqrt(sum / samples) << " ms rms settled, " << after
+              << " ms at worst after the stall, rate "
+              << s.rate << " for 1.002, " << s.gaps << " underruns of " << s.gapTime << " ms in all, "
+              << s.resyncs << " resyncs" << (s.gaps == 1 && s.resyncs == 2 ? "" : ", EVENTS MISSED") << "\n";
+}
+
+/************/
+/* TIMELINE */
+/************/
+
+// what a step leaves behind: the scene, the camera and the ambient light
+struct TimelineState
+{
+    std::vector<float> spheres, lights;
+    vec3 origin, target;
+    float ambient;
+
+    TimelineState(const Timeline& timeline, const SceneStore& scene)
+        : origin(timeline.cameraOrigin), target(timeline.cameraTarget), ambient(timeline.ambientLight)
+    {
+        for (int f = 0; f < SceneStore::FIELDS; ++f)
+        {
+            const float* c = scene.column(SceneStore::Field(f));
+            spheres.insert(spheres.end(), c, c + scene.size());
+        }
+        for (int f = 0; f < SceneStore::LIGHT_FIELDS; ++f)
+        {
+            const float* c = scene.lightColumn(SceneStore::LightField(f));
+            lights.insert(lights.end(), c, c + scene.lightsSize());
+        }
+    }
+
+    bool operator==(const TimelineState& s) const
+    {
+        return spheres == s.spheres && lights == s.lights && ambient == s.ambient
+            && origin.x == s.origin.x && origin.y == s.origin.y && origin.z == s.origin.z
+            && target.x == s.target.x && target.y == s.target.y && target.z == s.target.z;
+    }
+};
+
+static void benchTimeline()
+{
+    std::cout << "timeline: timeline.txt, played then seeked\n";
+
+    Timeline played;
+    if (!played.load("timeline.txt"))
+        return;
+
+    // every frame at 60 fps, in order
+    SceneStore scene;
+    std::vector<TimelineState> states;
+    for (unsigned frame = 0; played.step(frame * 1000.0 / 60, scene); ++frame)
+        states.push_back(TimelineState(played, scene));
+
+    // the same frames in any order, each one from where the last seek left
+    Timeline seeked;
+    seeked.load("timeline.txt");
+    SceneStore at;
+    const int seeks = 3000;
+    int differ = 0;
+    for (int k = 0; k < seeks; ++k)
+    {
+        unsigned frame = rand() % states.size();
+        seeked.step(frame * 1000.0 / 60, at);
+        differ += !(TimelineState(seeked, at) == states[frame]);
+    }
+    std::cout << "  " << states.size() << " frames at 60 fps, " << seeks << " seeks to random ones";
+    if (differ)
+        std::cout << ", STATES DIFFER for " << differ;
+    std::cout << "\n";
+
+    // what a step costs, over the whole show
+    Timeline timed;
+    timed.load("timeline.txt");
+    double t = now();
+    unsigned frames = 0;
+    while (timed.step(frames * 1000.0 / 60, scene))
+        ++frames;
+    t = (now() - t) / frames;
+
+    // played at 3 fps, against seeks to the same times, and how many tics
+    // a frame fell in
+    Timeline slow;
+    slow.load("timeline.txt");
+    SceneStore sparse;
+    unsigned tics = 0, last = 0;
+    differ = 0;
+    frames = 0;
+    for (; slow.step(frames * 1000.0 / 3, sparse); ++frames)
+    {
+        seeked.step(frames * 1000.0 / 3, at);
+        differ += !(TimelineState(seeked, at) == TimelineState(slow, sparse));
+        unsigned tic = slow.ticAt(frames * 1000.0 / 3);
+        tics += tic != last;
+        last = tic;
+    }
+    std::cout << "  " << t * 1e6 << " us per step; at 3 fps " << frames << " frames in " << tics << " of "
+              << last << " tics";
+    if (differ)
+        std::cout << ", STATES DIFFER for " << differ;
+    std::cout << "\n";
+
+    // beat(time(b)) across tempo changes, one of them off the beat
+    BeatClock beats(129, 250);
+    beats.setTempo(16, 140);
+    beats.setTempo(40.5, 90);
+    beats.setTempo(64, 172);
+    double worst = 0;
+    for (double b = -4; b < 128; b += 1 / 64.0)
+        worst = std::max(worst, fabs(beats.beat(beats.time(b)) - b));
+    std::cout << "  beat(time(b)) within " << worst << " beat over 128 beats and three tempo changes"
+              << (worst < 1e-9 ? "" : ", ROUND TRIP OFF") << "\n";
+
+    // tics out of range are parse errors, the largest one is not
+    const char* ranges[] = {"enter 0", "enter -1", "until 1000001", "enter 4294967295", "until 4294967296",
+                            "enter 1000000"};
+    std::ostringstream errors;
+    std::streambuf* out = std::cout.rdbuf(errors.rdbuf());
+    int wrong = 0;
+    for (const char* text : ranges)
+    {
+        Timeline parsed;
+        wrong += parsed.parse(text) != (text == ranges[5]);
+    }
+    std::cout.rdbuf(out);
+    std::cout << "  tics out of range rejected" << (wrong ? ", TICS MISPARSED" : "") << "\n";
+}
+
+/********/
+/* MAIN */
+/********/
+
+struct Section
+{
+    const char* name;
+    void (*run)();
+};
+
+static const Section sections[] = {
+    {"intersect", benchIntersect},
+    {"scene", benchScene},
+    {"bvh", benchBvh},
+    {"refit", benchRefit},
+    {"render", benchRender},
+    {"traversal", benchTraversal},
+    {"wavefront", benchWavefront},
+    {"shadows", benchShadows},
+    {"culling", benchCulling},
+    {"audio", benchAudio},
+    {"timeline", benchTimeline},
+};
+
+int main(int argc, char** argv)
+{
+    std::cout << "cpu: " << simdLevelName(detectSimdLevel()) << "\n";
+
+    for (const Section& s : sections)
+    {
+        bool selected = argc < 2;
+        for (int i = 1; i < argc; ++i)
+            selected |= !strcmp(argv[i], s.name);
+        if (selected)
+            s.run();
+    }
+
+    return 0;
+}
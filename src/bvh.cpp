@@ -0,0 +1,482 @@
+#include "bvh.hpp"
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+
+// relative cost of a box test against a sphere test, for the SAH
+#define TRAVERSAL_COST  1.0f
+
+/*******/
+/* BOX */
+/*******/
+
+void Bvh::Box::reset()
+{
+    min[0] = min[1] = min[2] = FLT_MAX;
+    max[0] = max[1] = max[2] = -FLT_MAX;
+}
+
+void Bvh::Box::grow(const Box& b)
+{
+    for (int k = 0; k < 3; ++k)
+    {
+        min[k] = std::min(min[k], b.min[k]);
+        max[k] = std::max(max[k], b.max[k]);
+    }
+}
+
+void Bvh::Box::grow(const float* p)
+{
+    for (int k = 0; k < 3; ++k)
+    {
+        min[k] = std::min(min[k], p[k]);
+        max[k] = std::max(max[k], p[k]);
+    }
+}
+
+float Bvh::Box::area() const
+{
+    float dx = max[0] - min[0], dy = max[1] - min[1], dz = max[2] - min[2];
+    if (dx < 0 || dy < 0 || dz < 0)
+        return 0;
+    return 2 * (dx * dy + dy * dz + dz * dx);
+}
+
+static double now()
+{
+    using namespace std::chrono;
+    return duration<double>(steady_clock::now().time_since_epoch()).count();
+}
+
+/*********/
+/* BUILD */
+/*********/
+
+// std::min() takes it by reference
+const int Bvh::MAX_PACKET;
+
+Bvh::Bvh()
+    : buildCost_(0), stats_()
+{
+}
+
+void Bvh::clear()
+{
+    nodes_.clear();
+    prims_.clear();
+}
+
+void Bvh::sphereBoxes(const SceneStore& scene)
+{
+    unsigned n = scene.size();
+    const float* x = scene.column(SceneStore::X);
+    const float* y = scene.column(SceneStore::Y);
+    const float* z = scene.column(SceneStore::Z);
+    const float* r = scene.column(SceneStore::R);
+
+    boxes_.resize(n);
+    centers_.resize(3 * n);
+    for (unsigned i = 0; i < n; ++i)
+    {
+        // padded so that rounding in intersectSphere() never hits outside
+        float pad = 1e-4f * (fabsf(r[i]) + fabsf(x[i]) + fabsf(y[i]) + fabsf(z[i])) + 1e-4f;
+        float c[3] = {x[i], y[i], z[i]};
+        for (int k = 0; k < 3; ++k)
+        {
+            boxes_[i].min[k] = c[k] - fabsf(r[i]) - pad;
+            boxes_[i].max[k] = c[k] + fabsf(r[i]) + pad;
+            centers_[3 * i + k] = c[k];
+        }
+    }
+}
+
+void Bvh::build(const SceneStore& scene)
+{
+    double t = now();
+    unsigned n = scene.size();
+    clear();
+    buildCost_ = 0;
+    if (!n)
+        return;
+
+    sphereBoxes(scene);
+    prims_.resize(n);
+    for (unsigned i = 0; i < n; ++i)
+        prims_[i] = i;
+
+    nodes_.reserve(2 * n);
+    buildNode(0, n);
+
+    buildCost_ = cost();
+    ++stats_.builds;
+    stats_.buildTime += now() - t;
+}
+
+void Bvh::setBox(BvhNode& node, const Box& box)
+{
+    for (int k = 0; k < 3; ++k)
+    {
+        node.min[k] = box.min[k];
+        node.max[k] = box.max[k];
+    }
+}
+
+Bvh::Box Bvh::bounds(unsigned first, unsigned count) const
+{
+    Box b;
+    b.reset();
+    for (unsigned i = first; i < first + count; ++i)
+        b.grow(boxes_[prims_[i]]);
+    return b;
+}
+
+unsigned Bvh::buildNode(unsigned first, unsigned count)
+{
+    unsigned index = nodes_.size();
+    Box box = bounds(first, count);
+
+    BvhNode node;
+    setBox(node, box);
+    node.index = first;
+    node.count = count;
+    nodes_.push_back(node);
+
+    if (count == 1)
+        return index;
+
+    // where the centers are
+    Box centers;
+    centers.reset();
+    for (unsigned i = first; i < first + count; ++i)
+        centers.grow(&centers_[3 * prims_[i]]);
+
+    // binned SAH: best plane between BINS bins of the centers, on any axis
+    int axis = -1;
+    unsigned split = 0;
+    float splitCost = FLT_MAX;
+    for (int k = 0; k < 3; ++k)
+    {
+        float extent = centers.max[k] - centers.min[k];
+        if (extent <= 0)
+            continue;
+        float scale = BINS / extent;
+
+        Box binBox[BINS];
+        unsigned binCount[BINS] = {0};
+        for (unsigned b = 0; b < BINS; ++b)
+            binBox[b].reset();
+        for (unsigned i = first; i < first + count; ++i)
+        {
+            int p = prims_[i];
+            unsigned b = std::min(unsigned((centers_[3 * p + k] - centers.min[k]) * scale), BINS - 1);
+            binBox[b].grow(boxes_[p]);
+            ++binCount[b];
+        }
+
+        // sweep from the right, then from the left
+        float rightArea[BINS];
+        unsigned rightCount[BINS];
+        Box acc;
+        acc.reset();
+        unsigned n = 0;
+        for (unsigned b = BINS - 1; b > 0; --b)
+        {
+            acc.grow(binBox[b]);
+            n += binCount[b];
+            rightArea[b] = acc.area();
+            rightCount[b] = n;
+        }
+
+        acc.reset();
+        n = 0;
+        for (unsigned b = 0; b < BINS - 1; ++b)
+        {
+            acc.grow(binBox[b]);
+            n += binCount[b];
+            if (!n || !rightCount[b + 1])
+                continue;
+            float cost = n * acc.area() + rightCount[b + 1] * rightArea[b + 1];
+            if (cost < splitCost)
+            {
+                splitCost = cost;
+                axis = k;
+                split = b + 1;
+            }
+        }
+    }
+
+    float area = box.area();
+    if (axis >= 0 && area > 0)
+        splitCost = TRAVERSAL_COST + splitCost / area;
+
+    if (count <= MAX_LEAF_SIZE && (axis < 0 || splitCost >= count))
+        return index;
+
+    unsigned mid;
+    if (axis >= 0)
+    {
+        float min = centers.min[axis];
+        float scale = BINS / (centers.max[axis] - min);
+        int* m = std::partition(&prims_[first], &prims_[first] + count, [&](int p) {
+            return std::min(unsigned((centers_[3 * p + axis] - min) * scale), BINS - 1) < split;
+        });
+        mid = m - &prims_[0];
+    }
+    else
+        // every center at the same place, halve the list
+        mid = first + count / 2;
+
+    buildNode(first, mid - first);
+    buildNode(mid, first + count - mid);
+
+    nodes_[index].index = nodes_.size();
+    nodes_[index].count = 0;
+    return index;
+}
+
+/*********/
+/* REFIT */
+/*********/
+
+void Bvh::refit(const SceneStore& scene)
+{
+    double t = now();
+    sphereBoxes(scene);
+
+    // children come after their parent: the first one right after, the
+    // second one where the first one's subtree ends
+    for (unsigned i = nodes_.size(); i-- > 0;)
+    {
+        BvhNode& node = nodes_[i];
+        if (node.count)
+        {
+            setBox(node, bounds(node.index, node.count));
+            continue;
+        }
+
+        const BvhNode& left = nodes_[i + 1];
+        const BvhNode& right = nodes_[left.count ? i + 2 : left.index];
+        for (int k = 0; k < 3; ++k)
+        {
+            node.min[k] = std::min(left.min[k], right.min[k]);
+            node.max[k] = std::max(left.max[k], right.max[k]);
+        }
+    }
+
+    ++stats_.refits;
+    stats_.refitTime += now() - t;
+}
+
+bool Bvh::update(const SceneStore& scene)
+{
+    if (scene.size() != prims_.size())
+    {
+        build(scene);
+        return true;
+    }
+
+    refit(scene);
+    if (cost() > BVH_REBUILD_RATIO * buildCost_)
+    {
+        build(scene);
+        return true;
+    }
+    return false;
+}
+
+float Bvh::cost() const
+{
+    if (nodes_.empty())
+        return 0;
+
+    const BvhNode& root = nodes_[0];
+    Box b;
+    for (int k = 0; k < 3; ++k)
+    {
+        b.min[k] = root.min[k];
+        b.max[k] = root.max[k];
+    }
+    float rootArea = b.area();
+    if (rootArea <= 0)
+        return 0;
+
+    float cost = 0;
+    for (const BvhNode& node : nodes_)
+    {
+        for (int k = 0; k < 3; ++k)
+        {
+            b.min[k] = node.min[k];
+            b.max[k] = node.max[k];
+        }
+        cost += b.area() / rootArea * (node.count ? node.count : TRAVERSAL_COST);
+    }
+    return cost;
+}
+
+/*************/
+/* TRAVERSAL */
+/*************/
+
+// 1 / d, kept finite so that 0 * inf never turns a box test into NaN
+static inline float invDir(float d)
+{
+    if (fabsf(d) < 1e-20f)
+        d = d < 0 ? -1e-20f : 1e-20f;
+    return 1 / d;
+}
+
+// whether the ray enters the box somewhere in [0, tmax]
+static inline bool hitBox(const BvhNode& n, const vec3& o, const vec3& inv, float tmax)
+{
+    float t0 = (n.min[0] - o.x) * inv.x, t1 = (n.max[0] - o.x) * inv.x;
+    float near = std::min(t0, t1), far = std::max(t0, t1);
+    t0 = (n.min[1] - o.y) * inv.y;
+    t1 = (n.max[1] - o.y) * inv.y;
+    near = std::max(near, std::min(t0, t1));
+    far = std::min(far, std::max(t0, t1));
+    t0 = (n.min[2] - o.z) * inv.z;
+    t1 = (n.max[2] - o.z) * inv.z;
+    near = std::max(near, std::min(t0, t1));
+    far = std::min(far, std::max(t0, t1));
+    return far >= std::max(near, 0.0f) && near <= tmax;
+}
+
+int Bvh::closestHit(const vec3& o, const vec3& dir, const SphereColumns& s, int skip, float& d,
+                    RayStats* stats) const
+{
+    vec3 inv = {invDir(dir.x), invDir(dir.y), invDir(dir.z)};
+    float dist = d;
+    int best = -1;
+    unsigned nodes = 0, spheres = 0;
+
+    unsigned i = 0, n = nodes_.size();
+    while (i < n)
+    {
+        const BvhNode& node = nodes_[i];
+        ++nodes;
+        if (!hitBox(node, o, inv, dist))
+        {
+            i = node.count ? i + 1 : node.index;
+            continue;
+        }
+
+        for (int k = node.index; k < node.index + node.count; ++k)
+        {
+            int p = prims_[k];
+            if (p == skip)
+                continue;
+            ++spheres;
+            float d_ = intersectSphere(o, dir, s.x[p], s.y[p], s.z[p], s.r[p]);
+            // the lowest index wins on a tie, as in the linear loop
+            if (d_ > 0 && (d_ < dist || (d_ == dist && p < best)))
+            {
+                dist = d_;
+                best = p;
+            }
+        }
+        ++i;
+    }
+
+    if (stats)
+    {
+        stats->rays += 1;
+        stats->nodes += nodes;
+        stats->spheres += spheres;
+    }
+    if (best >= 0)
+        d = dist;
+    return best;
+}
+
+bool Bvh::anyHit(const vec3& o, const vec3& dir, const SphereColumns& s, int skip, RayStats* stats) const
+{
+    vec3 inv = {invDir(dir.x), invDir(dir.y), invDir(dir.z)};
+    unsigned nodes = 0, spheres = 0;
+    bool hit = false;
+
+    unsigned i = 0, n = nodes_.size();
+    while (i < n && !hit)
+    {
+        const BvhNode& node = nodes_[i];
+        ++nodes;
+        if (!hitBox(node, o, inv, FLT_MAX))
+        {
+            i = node.count ? i + 1 : node.index;
+            continue;
+        }
+
+        for (int k = node.index; k < node.index + node.count && !hit; ++k)
+        {
+            int p = prims_[k];
+            if (p == skip)
+                continue;
+            ++spheres;
+            hit = intersectSphere(o, dir, s.x[p], s.y[p], s.z[p], s.r[p]) > 0;
+        }
+        ++i;
+    }
+
+    if (stats)
+    {
+        stats->rays += 1;
+        stats->nodes += nodes;
+        stats->spheres += spheres;
+    }
+    return hit;
+}
+
+void Bvh::closestHitPacket(const RayColumns& rays, int n, const SphereColumns& s, int* hit, float* d,
+                           RayStats* stats) const
+{
+    vec3 inv[MAX_PACKET];
+    float dist[MAX_PACKET];
+    for (int r = 0; r < n; ++r)
+    {
+        inv[r] = {invDir(rays.dx[r]), invDir(rays.dy[r]), invDir(rays.dz[r])};
+        dist[r] = d[r];
+        hit[r] = -1;
+    }
+    unsigned nodes = 0, spheres = 0;
+
+    unsigned i = 0, size = nodes_.size();
+    while (i < size)
+    {
+        const BvhNode& node = nodes_[i];
+        ++nodes;
+
+        // entered if one ray does, each one with its own closest hit so far
+        bool enter = false;
+        for (int r = 0; r < n && !enter; ++r)
+            enter = hitBox(node, {rays.ox[r], rays.oy[r], rays.oz[r]}, inv[r], dist[r]);
+        if (!enter)
+        {
+            i = node.count ? i + 1 : node.index;
+            continue;
+        }
+
+        for (int k = node.index; k < node.index + node.count; ++k)
+        {
+            int p = prims_[k];
+            float d_[MAX_PACKET];
+            ++spheres;
+            intersectPacket(rays, n, {s.x[p], s.y[p], s.z[p], s.r[p]}, d_);
+            for (int r = 0; r < n; ++r)
+                if (d_[r] > 0 && (d_[r] < dist[r] || (d_[r] == dist[r] && p < hit[r])))
+                {
+                    dist[r] = d_[r];
+                    hit[r] = p;
+                }
+        }
+        ++i;
+    }
+
+    for (int r = 0; r < n; ++r)
+        if (hit[r] >= 0)
+            d[r] = dist[r];
+    if (stats)
+    {
+        stats->rays += n;
+        stats->nodes += nodes;
+        stats->spheres += spheres;
+    }
+}
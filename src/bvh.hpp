@@ -0,0 +1,121 @@
+#ifndef BVH_HPP
+#define BVH_HPP
+
+#include <vector>
+#include "vec.hpp"
+#include "intersect.hpp"
+#include "scene.hpp"
+
+/*
+  Bounding volume hierarchy over the spheres of a SceneStore.
+
+  Built top-down with a binned surface area heuristic, then flattened in
+  depth-first order: the first child of an inner node is the next node, and
+  every inner node knows where to go once its subtree is done or missed
+  (escape). A leaf's escape is always the node after it, so leaves reuse
+  that slot for their first primitive. This is walked without a stack, the
+  same way by the CPU renderer and by fragment.glsl.
+
+  Queries give exactly the brute force answers (same sphere on equal
+  distances): the boxes are slightly padded so they never cull a sphere the
+  exact test would hit.
+
+  Moving spheres don't need a new tree: refit() recomputes the boxes bottom
+  up in O(n), children always coming after their parent. The tree gets worse
+  as the spheres drift away from where it was built, so update() rebuilds it
+  once its SAH cost has grown too much since the last build.
+*/
+
+struct BvhNode
+{
+    float min[3];
+    int index;    // inner node: escape, leaf: first primitive in prims()
+    float max[3];
+    int count;    // spheres in the leaf, 0 for inner nodes
+};
+
+// how much the SAH cost may grow through refits before update() rebuilds
+#define BVH_REBUILD_RATIO   1.3f
+
+// what the updates cost
+struct BvhStats
+{
+    unsigned builds;
+    unsigned refits;
+    double buildTime;   // seconds, all builds
+    double refitTime;   // seconds, all refits
+};
+
+class Bvh
+{
+public:
+    // most spheres in a leaf, and bins tried per axis
+    static const unsigned MAX_LEAF_SIZE = 4;
+    static const unsigned BINS = 16;
+    // most rays in closestHitPacket()
+    static const int MAX_PACKET = 64;
+
+    Bvh();
+
+    void build(const SceneStore& scene);
+    void clear();
+
+    // same tree, boxes fitted to the spheres as they are now; scene must
+    // have as many spheres as at build()
+    void refit(const SceneStore& scene);
+    // refit, or build if the number of spheres changed or the cost grew by
+    // past BVH_REBUILD_RATIO times buildCost(); true if it was built
+    bool update(const SceneStore& scene);
+
+    bool empty() const { return nodes_.empty(); }
+    const std::vector<BvhNode>& nodes() const { return nodes_; }
+    // sphere indices, leaf after leaf
+    const std::vector<int>& prims() const { return prims_; }
+
+    // same as the functions of intersect.hpp, fetches counted in stats
+    int closestHit(const vec3& o, const vec3& dir, const SphereColumns& s, int skip, float& d,
+                   RayStats* stats = NULL) const;
+    bool anyHit(const vec3& o, const vec3& dir, const SphereColumns& s, int skip,
+                RayStats* stats = NULL) const;
+    // closestHit() of n <= MAX_PACKET rays at once (nothing skipped), hit[k]
+    // and d[k] for ray k: the walk enters a node if one ray of the packet
+    // does, then tests its spheres against all of them (intersectPacket)
+    void closestHitPacket(const RayColumns& rays, int n, const SphereColumns& s, int* hit, float* d,
+                          RayStats* stats = NULL) const;
+
+    // expected cost of a ray, relative to the root box (SAH)
+    float cost() const;
+    // cost() right after the last build
+    float buildCost() const { return buildCost_; }
+
+    const BvhStats& stats() const { return stats_; }
+
+private:
+    struct Box
+    {
+        float min[3];
+        float max[3];
+
+        void reset();
+        void grow(const Box& b);
+        void grow(const float* p);
+        float area() const;
+    };
+
+    void sphereBoxes(const SceneStore& scene);
+    unsigned buildNode(unsigned first, unsigned count);
+    Box bounds(unsigned first, unsigned count) const;
+    void setBox(BvhNode& node, const Box& box);
+
+    std::vector<BvhNode> nodes_;
+    std::vector<int> prims_;
+
+    // build data, per sphere
+    std::vector<Box> boxes_;
+    std::vector<float> centers_;  // x, y, z
+
+    float buildCost_;
+    BvhStats stats_;
+};
+
+#endif
@@ -0,0 +1,461 @@
+#include "capture.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+
+static double now()
+{
+    using namespace std::chrono;
+    return duration<double>(steady_clock::now().time_since_epoch()).count();
+}
+
+static bool endsWith(const std::string& s, const char* end)
+{
+    std::string e(end);
+    return s.size() >= e.size() && s.compare(s.size() - e.size(), e.size(), e) == 0;
+}
+
+/*******/
+/* PNG */
+/*******/
+
+static unsigned crc32(unsigned crc, const unsigned char* p, unsigned n)
+{
+    static unsigned table[256];
+    if (!table[1])
+        for (unsigned i = 0; i < 256; ++i)
+        {
+            unsigned c = i;
+            for (int k = 0; k < 8; ++k)
+                c = c & 1 ? 0xedb88320 ^ (c >> 1) : c >> 1;
+            table[i] = c;
+        }
+
+    crc = ~crc;
+    for (unsigned i = 0; i < n; ++i)
+        crc = table[(crc ^ p[i]) & 0xff] ^ (crc >> 8);
+    return ~crc;
+}
+
+static void put32(std::vector<unsigned char>& v, unsigned x)
+{
+    v.push_back(x >> 24);
+    v.push_back(x >> 16);
+    v.push_back(x >> 8);
+    v.push_back(x);
+}
+
+static void chunk(std::ofstream& out, const char* type, const std::vector<unsigned char>& data)
+{
+    std::vector<unsigned char> c;
+    put32(c, data.size());
+    c.insert(c.end(), type, type + 4);
+    c.insert(c.end(), data.begin(), data.end());
+    put32(c, crc32(0, &c[4], c.size() - 4));
+    out.write((const char*)c.data(), c.size());
+}
+
+// zlib stream made of stored deflate blocks: bigger files, but no zlib
+void FrameWriter::writePng(std::ofstream& out, const Framebuffer& fb)
+{
+    static const unsigned char signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+    out.write((const char*)signature, 8);
+
+    std::vector<unsigned char> header;
+    put32(header, fb.width);
+    put32(header, fb.height);
+    header.push_back(8);  // bits per channel
+    header.push_back(2);  // RGB
+    header.push_back(0);
+    header.push_back(0);
+    header.push_back(0);
+    chunk(out, "IHDR", header);
+
+    // rows, each one after its filter byte (none)
+    unsigned stride = fb.width * 3;
+    std::vector<unsigned char> raw;
+    raw.reserve((stride + 1) * fb.height);
+    for (unsigned y = 0; y < fb.height; ++y)
+    {
+        raw.push_back(0);
+        raw.insert(raw.end(), &rgb_[y * stride], &rgb_[y * stride] + stride);
+    }
+
+    std::vector<unsigned char> z;
+    z.push_back(0x78);
+    z.push_back(0x01);
+    for (unsigned i = 0; i < raw.size(); i += 0xffff)
+    {
+        unsigned n = std::min<unsigned>(raw.size() - i, 0xffff);
+        z.push_back(i + n == raw.size());
+        z.push_back(n);
+        z.push_back(n >> 8);
+        z.push_back(~n);
+        z.push_back(~n >> 8);
+        z.insert(z.end(), raw.begin() + i, raw.begin() + i + n);
+    }
+    unsigned a = 1, b = 0;
+    for (unsigned char c : raw)
+    {
+        a = (a + c) % 65521;
+        b = (b + a) % 65521;
+    }
+    put32(z, b << 16 | a);
+    chunk(out, "IDAT", z);
+
+    chunk(out, "IEND", std::vector<unsigned char>());
+}
+
+/****************/
+/* FRAME WRITER */
+/****************/
+
+FrameWriter::FrameWriter()
+    : format_(RAW), width_(0), zeros_(false), frames_(0)
+{
+}
+
+// splits a printf-like name around its one frame number, %[0][width]d or
+// %[0][width]u ("%%" is a '%'); false for any other conversion
+static bool splitPattern(const std::string& path, std::string& prefix, std::string& suffix,
+                         unsigned& width, bool& zeros)
+{
+    prefix.clear();
+    suffix.clear();
+    bool found = false;
+    for (size_t i = 0; i < path.size(); ++i)
+    {
+        std::string& part = found ? suffix : prefix;
+        if (path[i] != '%')
+        {
+            part += path[i];
+            continue;
+        }
+        if (i + 1 < path.size() && path[i + 1] == '%')
+        {
+            part += '%';
+            ++i;
+            continue;
+        }
+        if (found)
+            return false;
+
+        ++i;
+        zeros = i < path.size() && path[i] == '0';
+        if (zeros)
+            ++i;
+        width = 0;
+        for (; i < path.size() && path[i] >= '0' && path[i] <= '9'; ++i)
+        {
+            width = width * 10 + (path[i] - '0');
+            if (width > 20)
+                return false;
+        }
+        if (i >= path.size() || (path[i] != 'd' && path[i] != 'u'))
+            return false;
+        found = true;
+    }
+    return found;
+}
+
+bool FrameWriter::open(const std::string& path)
+{
+    frames_ = 0;
+
+    if (endsWith(path, ".rgb"))
+    {
+        format_ = RAW;
+        raw_.open(path.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+        return raw_.good();
+    }
+
+    if (endsWith(path, ".ppm"))
+        format_ = PPM;
+    else if (endsWith(path, ".png"))
+        format_ = PNG;
+    else
+        return false;
+
+    // one image per frame needs a number in the name
+    return splitPattern(path, prefix_, suffix_, width_, zeros_);
+}
+
+bool FrameWriter::write(const Framebuffer& fb)
+{
+    // Framebuffer is RGBA, bottom row first
+    unsigned stride = fb.width * 3;
+    rgb_.resize(stride * fb.height);
+    for (unsigned y = 0; y < fb.height; ++y)
+    {
+        const unsigned char* src = &fb.pixels[(fb.height - 1 - y) * fb.width * 4];
+        unsigned char* dst = &rgb_[y * stride];
+        for (unsigned x = 0; x < fb.width; ++x, src += 4, dst += 3)
+        {
+            dst[0] = src[0];
+            dst[1] = src[1];
+            dst[2] = src[2];
+        }
+    }
+
+    ++frames_;
+    if (format_ == RAW)
+    {
+        raw_.write((const char*)rgb_.data(), rgb_.size());
+        return raw_.good();
+    }
+
+    // only the number goes through printf, never the user's path
+    char number[32];
+    snprintf(number, sizeof(number), zeros_ ? "%0*u" : "%*u", int(width_), frames_ - 1);
+    std::string name = prefix_ + number + suffix_;
+    std::ofstream out(name.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+    if (format_ == PPM)
+    {
+        out << "P6\n" << fb.width << " " << fb.height << "\n255\n";
+        out.write((const char*)rgb_.data(), rgb_.size());
+    }
+    else
+        writePng(out, fb);
+    return out.good();
+}
+
+/********************/
+/* CAPTURE PIPELINE */
+/********************/
+
+CapturePipeline::CapturePipeline(FrameWriter& writer)
+    : writer_(writer), gl_(false), width_(0), height_(0), next_(0), inFlight_(0),
+      busy_(false), done_(false), failed_(false), error_(NULL), stats_()
+{
+    for (Slot& s : slots_)
+    {
+        s.buffer = 0;
+        s.fence = 0;
+        s.issued = 0;
+    }
+}
+
+CapturePipeline::~CapturePipeline()
+{
+    finish();
+}
+
+void CapturePipeline::start(unsigned width, unsigned height, bool gl)
+{
+    gl_ = gl;
+    width_ = width;
+    height_ = height;
+
+    if (gl_)
+    {
+        for (Slot& s : slots_)
+        {
+            glGenBuffers(1, &s.buffer);
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, s.buffer);
+            glBufferData(GL_PIXEL_PACK_BUFFER, width * height * 4, NULL, GL_STREAM_READ);
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    }
+
+    thread_ = std::thread(&CapturePipeline::writerLoop, this);
+}
+
+void CapturePipeline::capture()
+{
+    // the slot to reuse holds the oldest frame in flight
+    Slot& s = slots_[next_];
+    if (inFlight_ == SLOTS)
+    {
+        readBack(s);
+        --inFlight_;
+    }
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, s.buffer);
+    glReadPixels(0, 0, width_, height_, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    s.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    s.issued = now();
+
+    next_ = (next_ + 1) % SLOTS;
+    ++inFlight_;
+}
+
+void CapturePipeline::readBack(Slot& s)
+{
+    double t = now();
+    GLenum status = glClientWaitSync(s.fence, 0, 0);
+    if (status == GL_TIMEOUT_EXPIRED)
+    {
+        ++stats_.stalls;
+        do
+            status = glClientWaitSync(s.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+        while (status == GL_TIMEOUT_EXPIRED);
+    }
+    glDeleteSync(s.fence);
+    s.fence = 0;
+    // the frame is lost, rather than written with the pixels of an older one
+    if (status == GL_WAIT_FAILED)
+    {
+        fail("readback error (fence wait failed)");
+        return;
+    }
+
+    Framebuffer fb;
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (!free_.empty())
+        {
+            std::swap(fb, free_.back());
+            free_.pop_back();
+        }
+    }
+    fb.resize(width_, height_);
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, s.buffer);
+    const void* p = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, width_ * height_ * 4, GL_MAP_READ_BIT);
+    bool mapped = p != NULL;
+    if (mapped)
+    {
+        memcpy(fb.pixels.data(), p, width_ * height_ * 4);
+        // false when the buffer was lost while mapped
+        mapped = glUnmapBuffer(GL_PIXEL_PACK_BUFFER) == GL_TRUE;
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    if (!mapped)
+    {
+        fail("readback error (PBO not mapped)");
+        return;
+    }
+
+    double done = now();
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        stats_.readbackWait += done - t;
+        stats_.readback += done - s.issued;
+        stats_.readbackMax = std::max(stats_.readbackMax, done - s.issued);
+    }
+
+    enqueue(fb);
+}
+
+void CapturePipeline::push(Framebuffer& fb)
+{
+    Framebuffer frame;
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (!free_.empty())
+        {
+            std::swap(frame, free_.back());
+            free_.pop_back();
+        }
+    }
+    std::swap(frame, fb);
+    enqueue(frame);
+}
+
+void CapturePipeline::enqueue(Framebuffer& fb)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (queue_.size() >= QUEUE)
+    {
+        ++stats_.waits;
+        double t = now();
+        changed_.wait(lock, [this]() { return queue_.size() < QUEUE; });
+        stats_.queueWait += now() - t;
+    }
+    queue_.push_back(Framebuffer());
+    std::swap(queue_.back(), fb);
+    changed_.notify_all();
+}
+
+void CapturePipeline::writerLoop()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (;;)
+    {
+        changed_.wait(lock, [this]() { return !queue_.empty() || done_; });
+        if (queue_.empty())
+            break;
+
+        Framebuffer fb;
+        std::swap(fb, queue_.front());
+        queue_.pop_front();
+        busy_ = true;
+        changed_.notify_all();
+
+        lock.unlock();
+        double t = now();
+        bool ok = writer_.write(fb);
+        t = now() - t;
+        lock.lock();
+
+        busy_ = false;
+        if (!ok && !failed_)
+        {
+            failed_ = true;
+            error_ = "write error";
+        }
+        ++stats_.frames;
+        stats_.encode += t;
+        stats_.encodeMax = std::max(stats_.encodeMax, t);
+        free_.push_back(Framebuffer());
+        std::swap(free_.back(), fb);
+        changed_.notify_all();
+    }
+}
+
+bool CapturePipeline::finish()
+{
+    if (!thread_.joinable())
+        return !failed_;
+
+    // oldest first
+    while (inFlight_)
+    {
+        readBack(slots_[(next_ + SLOTS - inFlight_) % SLOTS]);
+        --inFlight_;
+    }
+    if (gl_)
+        for (Slot& s : slots_)
+        {
+            glDeleteBuffers(1, &s.buffer);
+            s.buffer = 0;
+        }
+
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        done_ = true;
+        changed_.notify_all();
+    }
+    thread_.join();
+    return !failed_;
+}
+
+bool CapturePipeline::failed()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    return failed_;
+}
+
+const char* CapturePipeline::error()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    return error_;
+}
+
+void CapturePipeline::fail(const char* error)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (!failed_)
+    {
+        failed_ = true;
+        error_ = error;
+    }
+}
+
+CaptureStats CapturePipeline::stats()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    return stats_;
+}
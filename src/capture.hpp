@@ -0,0 +1,138 @@
+#ifndef CAPTURE_HPP
+#define CAPTURE_HPP
+
+#include <condition_variable>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "gl.hpp"
+#include "raytracer.hpp"
+
+/*
+  Frames to disk, for offline rendering.
+
+  The format comes from the path:
+    out/frame%05d.ppm   one binary PPM per frame, numbered printf-like
+    out/frame%05d.png   same as PNG (uncompressed, no zlib needed)
+    out.rgb             every frame back to back as raw RGB24, top row first
+                        (ffmpeg -f rawvideo -pix_fmt rgb24 -s 800x600 -i ...)
+
+  CapturePipeline keeps the three stages busy at once: while frame N is
+  rendered, frame N-1 is copied by the GPU into one of the pixel buffer
+  objects (an asynchronous glReadPixels, fenced), and older frames are
+  written by a worker thread. Mapping a PBO only waits if its fence is not
+  signaled yet, which is counted as a stall.
+*/
+
+class FrameWriter
+{
+public:
+    enum Format { PPM, PNG, RAW };
+
+    FrameWriter();
+
+    // false if the path is neither a raw stream nor an image pattern with
+    // exactly one number, %[0][width]d or %[0][width]u
+    bool open(const std::string& path);
+    // false on I/O error
+    bool write(const Framebuffer& fb);
+
+    Format format() const { return format_; }
+    unsigned frames() const { return frames_; }
+
+private:
+    void writePng(std::ofstream& out, const Framebuffer& fb);
+
+    Format format_;
+    // image names: prefix_, the frame number over width_ digits, suffix_
+    std::string prefix_, suffix_;
+    unsigned width_;
+    bool zeros_;
+    std::ofstream raw_;
+    unsigned frames_;
+    std::vector<unsigned char> rgb_;  // one frame, top row first
+};
+
+// latency of each stage, in seconds
+struct CaptureStats
+{
+    unsigned frames;        // handed to the writer
+    unsigned stalls;        // PBOs mapped before the GPU was done with them
+    unsigned waits;         // frames that waited for room in the writer queue
+
+    double readback;        // glReadPixels issued to pixels in memory, total
+    double readbackMax;
+    double readbackWait;    // blocked mapping PBOs, total
+    double encode;          // FrameWriter::write, total
+    double encodeMax;
+    double queueWait;       // blocked on a full queue, total
+};
+
+class CapturePipeline
+{
+public:
+    static const unsigned SLOTS = 3;    // PBOs in flight
+    static const unsigned QUEUE = 3;    // frames waiting for the writer
+
+    explicit CapturePipeline(FrameWriter& writer);
+    ~CapturePipeline();
+    CapturePipeline(const CapturePipeline&) = delete;
+    CapturePipeline& operator=(const CapturePipeline&) = delete;
+
+    // gl: frames come from the current GL framebuffer (capture()),
+    // otherwise from memory (push())
+    void start(unsigned width, unsigned height, bool gl);
+
+    // once the frame is drawn: starts its readback, and hands the oldest
+    // one in flight to the writer
+    void capture();
+    // a frame rendered on the CPU; fb is swapped with a recycled buffer
+    void push(Framebuffer& fb);
+
+    // drains the PBOs and the writer; false if a readback or a write failed
+    bool finish();
+
+    bool failed();
+    // what failed first, NULL if nothing did
+    const char* error();
+    // snapshot, the writer updates them as it goes
+    CaptureStats stats();
+
+private:
+    struct Slot
+    {
+        GLuint buffer;
+        GLsync fence;
+        double issued;
+    };
+
+    void readBack(Slot& s);
+    void fail(const char* error);
+    void enqueue(Framebuffer& fb);
+    void writerLoop();
+
+    FrameWriter& writer_;
+    bool gl_;
+    unsigned width_;
+    unsigned height_;
+
+    Slot slots_[SLOTS];
+    unsigned next_;     // slot of the next capture()
+    unsigned inFlight_;
+
+    std::thread thread_;
+    std::mutex mutex_;
+    std::condition_variable changed_;
+    std::deque<Framebuffer> queue_;
+    std::vector<Framebuffer> free_;
+    bool busy_;         // the writer holds a frame
+    bool done_;
+    bool failed_;
+    const char* error_;
+    CaptureStats stats_;
+};
+
+#endif
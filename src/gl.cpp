@@ -0,0 +1,138 @@
+#include "gl.hpp"
+#include <cstring>
+
+bool hasGlVersion(int major, int minor)
+{
+    GLint ma = 0, mi = 0;
+    glGetIntegerv(GL_MAJOR_VERSION, &ma);
+    glGetIntegerv(GL_MINOR_VERSION, &mi);
+    return ma > major || (ma == major && mi >= minor);
+}
+
+bool hasGlExtension(const char* name)
+{
+    GLint n = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &n);
+    for (GLint i = 0; i < n; ++i)
+        if (!strcmp((const char*)glGetStringi(GL_EXTENSIONS, i), name))
+            return true;
+    return false;
+}
+
+/*******************/
+/* SCREEN TRIANGLE */
+/*******************/
+
+void ScreenTriangle::init()
+{
+    glGenVertexArrays(1, &vao_);
+}
+
+void ScreenTriangle::draw()
+{
+    glBindVertexArray(vao_);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+    glBindVertexArray(0);
+}
+
+/**************/
+/* PIXEL BLIT */
+/**************/
+
+void PixelBlit::init(unsigned width, unsigned height)
+{
+    width_ = width;
+    height_ = height;
+
+    glGenTextures(1, &texture_);
+    glBindTexture(GL_TEXTURE_2D, texture_);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    GLint read;
+    glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &read);
+    glGenFramebuffers(1, &fbo_);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, fbo_);
+    glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture_, 0);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, read);
+}
+
+void PixelBlit::draw(const unsigned char* pixels)
+{
+    glBindTexture(GL_TEXTURE_2D, texture_);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width_, height_, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    // frames are read back from the read framebuffer, it is put back
+    GLint read;
+    glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &read);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, fbo_);
+    glBlitFramebuffer(0, 0, width_, height_, 0, 0, width_, height_, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, read);
+}
+
+/*************/
+/* GPU TIMER */
+/*************/
+
+GpuTimer::GpuTimer()
+    : enabled_(false), queries_(), tags_(), first_(0), pending_(0)
+{
+}
+
+bool GpuTimer::init()
+{
+    enabled_ = hasGlVersion(3, 3) || hasGlExtension("GL_ARB_timer_query");
+    if (enabled_)
+        glGenQueries(QUERIES, queries_);
+    return enabled_;
+}
+
+void GpuTimer::begin(GLuint tag)
+{
+    if (!enabled_)
+        return;
+
+    // all in flight, the oldest one is given up
+    if (pending_ == QUERIES)
+    {
+        first_ = (first_ + 1) % QUERIES;
+        --pending_;
+    }
+
+    unsigned i = (first_ + pending_) % QUERIES;
+    tags_[i] = tag;
+    glBeginQuery(GL_TIME_ELAPSED, queries_[i]);
+}
+
+void GpuTimer::end()
+{
+    if (!enabled_)
+        return;
+
+    glEndQuery(GL_TIME_ELAPSED);
+    ++pending_;
+}
+
+bool GpuTimer::result(double& seconds, GLuint& tag, bool wait)
+{
+    if (!pending_)
+        return false;
+
+    GLint available = wait;
+    if (!wait)
+        glGetQueryObjectiv(queries_[first_], GL_QUERY_RESULT_AVAILABLE, &available);
+    if (!available)
+        return false;
+
+    GLuint64 ns = 0;
+    glGetQueryObjectui64v(queries_[first_], GL_QUERY_RESULT, &ns);
+    seconds = ns * 1e-9;
+    tag = tags_[first_];
+
+    first_ = (first_ + 1) % QUERIES;
+    --pending_;
+    return true;
+}
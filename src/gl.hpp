@@ -0,0 +1,76 @@
+#ifndef GL_HPP
+#define GL_HPP
+
+// OpenGL with every entry point up to what glext.h knows
+#define GL_GLEXT_PROTOTYPES
+#include <SFML/OpenGL.hpp>
+#include <GL/glext.h>
+
+// whether the current context is at least major.minor
+bool hasGlVersion(int major, int minor);
+// whether the current context exposes the extension
+bool hasGlExtension(const char* name);
+
+// the triangle covering the viewport that fragment.glsl runs on: no vertex
+// data, vertex.glsl places it from gl_VertexID, with an empty vertex array
+// object as a core profile wants one bound
+class ScreenTriangle
+{
+public:
+    ScreenTriangle() : vao_(0) {}
+
+    void init();
+    void draw();
+
+private:
+    GLuint vao_;
+};
+
+// RGBA8 pixels, bottom row first, copied over the framebuffer the way
+// glDrawPixels did, but through a texture and glBlitFramebuffer
+class PixelBlit
+{
+public:
+    PixelBlit() : width_(0), height_(0), texture_(0), fbo_(0) {}
+
+    void init(unsigned width, unsigned height);
+    void draw(const unsigned char* pixels);
+
+private:
+    unsigned width_;
+    unsigned height_;
+    GLuint texture_;
+    GLuint fbo_;    // read framebuffer with the texture attached
+};
+
+// GPU time of what is drawn between begin() and end(), known a few frames
+// later (GL 3.3 or ARB_timer_query); each measure carries a tag, such as
+// the program it timed
+class GpuTimer
+{
+public:
+    static const unsigned QUERIES = 4;
+
+    GpuTimer();
+
+    // false without timer queries, begin() and end() then do nothing
+    bool init();
+    bool enabled() const { return enabled_; }
+
+    // not nested: the queries are GL_TIME_ELAPSED
+    void begin(GLuint tag = 0);
+    void end();
+
+    // the oldest measure not read yet, if the GPU has it (or once it has it
+    // with wait); results whose query had to be reused are dropped
+    bool result(double& seconds, GLuint& tag, bool wait = false);
+
+private:
+    bool enabled_;
+    GLuint queries_[QUERIES];
+    GLuint tags_[QUERIES];
+    unsigned first_;    // oldest query in flight
+    unsigned pending_;  // queries in flight
+};
+
+#endif
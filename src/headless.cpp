@@ -0,0 +1,148 @@
+#include "headless.hpp"
+#include <iostream>
+#ifndef NO_EGL
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+
+HeadlessContext::HeadlessContext()
+    : display_(NULL), context_(NULL), fbo_(0), color_(0), depth_(0)
+{
+}
+
+HeadlessContext::~HeadlessContext()
+{
+    destroy();
+}
+
+#ifdef NO_EGL
+
+bool HeadlessContext::create(unsigned width, unsigned height)
+{
+    std::cout << "headless: built without EGL\n";
+    return false;
+}
+
+void HeadlessContext::destroy()
+{
+}
+
+#else
+
+bool HeadlessContext::create(unsigned width, unsigned height)
+{
+    // surfaceless if the client library knows about it
+    EGLDisplay display = EGL_NO_DISPLAY;
+    PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+        (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+    if (getPlatformDisplay)
+        display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+    if (display == EGL_NO_DISPLAY)
+        display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+
+    EGLint major, minor;
+    if (display == EGL_NO_DISPLAY || !eglInitialize(display, &major, &minor))
+    {
+        std::cout << "headless: no EGL display\n";
+        return false;
+    }
+    display_ = display;
+
+    // no window surface on a surfaceless display, pbuffer configs are there
+    const EGLint attribs[] = {
+        EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+        EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+        EGL_RED_SIZE, 8, EGL_GREEN_SIZE, 8, EGL_BLUE_SIZE, 8,
+        EGL_NONE
+    };
+    EGLConfig config;
+    EGLint configs = 0;
+    if (!eglBindAPI(EGL_OPENGL_API) || !eglChooseConfig(display, attribs, &config, 1, &configs) || !configs)
+    {
+        std::cout << "headless: no desktop GL config\n";
+        return false;
+    }
+
+    // a 3.3 core profile, the compatibility one for drivers without it
+    const EGLint coreAttribs[] = {
+        EGL_CONTEXT_MAJOR_VERSION, 3, EGL_CONTEXT_MINOR_VERSION, 3,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+        EGL_NONE
+    };
+    const EGLint compatibilityAttribs[] = {
+        EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_COMPATIBILITY_PROFILE_BIT,
+        EGL_NONE
+    };
+    EGLContext context = eglCreateContext(display, config, EGL_NO_CONTEXT, coreAttribs);
+    if (context == EGL_NO_CONTEXT)
+        context = eglCreateContext(display, config, EGL_NO_CONTEXT, compatibilityAttribs);
+    if (context == EGL_NO_CONTEXT)
+    {
+        std::cout << "headless: cannot create a GL context\n";
+        return false;
+    }
+    context_ = context;
+
+    // no surface at all, everything goes to the FBO
+    if (!eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context))
+    {
+        std::cout << "headless: surfaceless contexts not supported\n";
+        return false;
+    }
+
+    if (!hasGlVersion(3, 1))
+    {
+        std::cout << "headless: GL " << (const char*)glGetString(GL_VERSION) << ", 3.1 needed\n";
+        return false;
+    }
+
+    glGenRenderbuffers(1, &color_);
+    glBindRenderbuffer(GL_RENDERBUFFER, color_);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+    glGenRenderbuffers(1, &depth_);
+    glBindRenderbuffer(GL_RENDERBUFFER, depth_);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+    glGenFramebuffers(1, &fbo_);
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo_);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, color_);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depth_);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+    {
+        std::cout << "headless: incomplete framebuffer\n";
+        return false;
+    }
+
+    // what the window would have set up
+    glDrawBuffer(GL_COLOR_ATTACHMENT0);
+    glReadBuffer(GL_COLOR_ATTACHMENT0);
+    glViewport(0, 0, width, height);
+    return true;
+}
+
+void HeadlessContext::destroy()
+{
+    if (!display_)
+        return;
+
+    if (context_)
+    {
+        if (fbo_)
+        {
+            glBindFramebuffer(GL_FRAMEBUFFER, 0);
+            glDeleteFramebuffers(1, &fbo_);
+            glDeleteRenderbuffers(1, &color_);
+            glDeleteRenderbuffers(1, &depth_);
+        }
+        eglMakeCurrent(display_, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+        eglDestroyContext(display_, context_);
+    }
+    eglTerminate(display_);
+
+    display_ = NULL;
+    context_ = NULL;
+    fbo_ = color_ = depth_ = 0;
+}
+
+#endif
@@ -0,0 +1,40 @@
+#ifndef HEADLESS_HPP
+#define HEADLESS_HPP
+
+#include "gl.hpp"
+
+/*
+  GL without a display, for CI and render farms.
+
+  An EGL context on Mesa's surfaceless platform (llvmpipe stands in for a
+  missing GPU) or, failing that, on the default EGL display. It is a 3.3
+  core profile context where the driver has one (the demo uses nothing the
+  core profile dropped), a compatibility one otherwise, and it renders into
+  an RGBA8 framebuffer object of the window's size instead of a window;
+  fragment.glsl runs unchanged.
+
+  Built without EGL (make EGL=0), create() always fails.
+*/
+
+class HeadlessContext
+{
+public:
+    HeadlessContext();
+    ~HeadlessContext();
+    HeadlessContext(const HeadlessContext&) = delete;
+    HeadlessContext& operator=(const HeadlessContext&) = delete;
+
+    // makes the context current with the FBO bound; false (with a message
+    // on std::cout) if there is no usable EGL or GL >= 3.1
+    bool create(unsigned width, unsigned height);
+    void destroy();
+
+private:
+    void* display_;     // EGLDisplay
+    void* context_;     // EGLContext
+    GLuint fbo_;
+    GLuint color_;
+    GLuint depth_;
+};
+
+#endif
@@ -0,0 +1,495 @@
+// keep a * b + c as two roundings like the scalar reference: avx512f comes
+// with FMA and GCC would otherwise fuse the vector products and sums
+#pragma GCC optimize ("fp-contract=off")
+
+#include "intersect.hpp"
+#include <algorithm>
+#include <immintrin.h>
+
+/**********/
+/* SCALAR */
+/**********/
+
+static int closestHitScalar(const vec3& o, const vec3& dir, const SphereColumns& s,
+                            int skip, float& d, int first, int best)
+{
+    for (int i = first; i < s.n; ++i)
+    {
+        if (i == skip)
+            continue;
+        float d_ = intersectSphere(o, dir, s.x[i], s.y[i], s.z[i], s.r[i]);
+        if (d_ > 0 && d_ < d)
+        {
+            d = d_;
+            best = i;
+        }
+    }
+    return best;
+}
+
+static int closestHitScalar(const vec3& o, const vec3& dir, const SphereColumns& s,
+                            int skip, float& d)
+{
+    float dist = 1e30;
+    int best = closestHitScalar(o, dir, s, skip, dist, 0, -1);
+    if (best >= 0)
+        d = dist;
+    return best;
+}
+
+static void closestHitPacketScalar(const RayColumns& rays, int n, const SphereColumns& s,
+                                   const int* skip, int* hit, float* d, int first = 0)
+{
+    for (int k = first; k < n; ++k)
+        hit[k] = closestHitScalar({rays.ox[k], rays.oy[k], rays.oz[k]}, {rays.dx[k], rays.dy[k], rays.dz[k]},
+                                  s, skip[k], d[k]);
+}
+
+static bool anyHitScalar(const vec3& o, const vec3& dir, const SphereColumns& s,
+                         int skip, int first = 0)
+{
+    for (int i = first; i < s.n; ++i)
+        if (i != skip && intersectSphere(o, dir, s.x[i], s.y[i], s.z[i], s.r[i]) > 0)
+            return true;
+    return false;
+}
+
+static void intersectPacketScalar(const RayColumns& rays, int n, const vec4& sphere,
+                                  float* d, int first = 0)
+{
+    for (int i = first; i < n; ++i)
+    {
+        vec3 o = {rays.ox[i], rays.oy[i], rays.oz[i]};
+        vec3 dir = {rays.dx[i], rays.dy[i], rays.dz[i]};
+        d[i] = intersectSphere(o, dir, sphere.x, sphere.y, sphere.z, sphere.w);
+    }
+}
+
+// merge per-lane closest hits: smallest distance, then smallest index
+static int reduceLanes(const float* dist, const int* idx, int lanes, float& d)
+{
+    int best = -1;
+    for (int l = 0; l < lanes; ++l)
+    {
+        if (idx[l] < 0)
+            continue;
+        if (best < 0 || dist[l] < d || (dist[l] == d && idx[l] < best))
+        {
+            d = dist[l];
+            best = idx[l];
+        }
+    }
+    return best;
+}
+
+/********/
+/* AVX2 */
+/********/
+
+#define AVX2 __attribute__((target("avx2")))
+
+// fragment.glsl's intersect() on 8 lanes
+AVX2 static inline __m256 intersect8(__m256 ox, __m256 oy, __m256 oz,
+                                     __m256 dx, __m256 dy, __m256 dz,
+                                     __m256 x, __m256 y, __m256 z, __m256 r)
+{
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 miss = _mm256_set1_ps(-1.0f);
+
+    __m256 dvx = _mm256_sub_ps(ox, x);
+    __m256 dvy = _mm256_sub_ps(oy, y);
+    __m256 dvz = _mm256_sub_ps(oz, z);
+    __m256 sqrr = _mm256_mul_ps(r, r);
+    __m256 b = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, dvx), _mm256_mul_ps(dy, dvy)),
+                             _mm256_mul_ps(dz, dvz));
+    __m256 dd = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dvx, dvx), _mm256_mul_ps(dvy, dvy)),
+                              _mm256_mul_ps(dvz, dvz));
+    __m256 delta = _mm256_add_ps(_mm256_mul_ps(b, b), _mm256_sub_ps(sqrr, dd));
+
+    __m256 sq = _mm256_sqrt_ps(delta);
+    __m256 nb = _mm256_xor_ps(b, _mm256_set1_ps(-0.0f));
+    __m256 d = _mm256_sub_ps(nb, sq);
+    __m256 D = _mm256_add_ps(nb, sq);
+
+    __m256 res = _mm256_blendv_ps(miss, D, _mm256_cmp_ps(D, zero, _CMP_GT_OQ));
+    res = _mm256_blendv_ps(res, d, _mm256_cmp_ps(d, zero, _CMP_GT_OQ));
+    return _mm256_blendv_ps(res, miss, _mm256_cmp_ps(delta, zero, _CMP_LT_OQ));
+}
+
+AVX2 static int closestHitAvx2(const vec3& o, const vec3& dir, const SphereColumns& s,
+                               int skip, float& d)
+{
+    __m256 ox = _mm256_set1_ps(o.x), oy = _mm256_set1_ps(o.y), oz = _mm256_set1_ps(o.z);
+    __m256 dx = _mm256_set1_ps(dir.x), dy = _mm256_set1_ps(dir.y), dz = _mm256_set1_ps(dir.z);
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256i skipv = _mm256_set1_epi32(skip);
+    const __m256i step = _mm256_set1_epi32(8);
+
+    __m256 best = _mm256_set1_ps(1e30f);
+    __m256i bestIdx = _mm256_set1_epi32(-1);
+    __m256i idx = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+
+    int i = 0;
+    for (; i + 8 <= s.n; i += 8, idx = _mm256_add_epi32(idx, step))
+    {
+        __m256 d_ = intersect8(ox, oy, oz, dx, dy, dz,
+                               _mm256_loadu_ps(s.x + i), _mm256_loadu_ps(s.y + i),
+                               _mm256_loadu_ps(s.z + i), _mm256_loadu_ps(s.r + i));
+        __m256 hit = _mm256_and_ps(_mm256_cmp_ps(d_, zero, _CMP_GT_OQ),
+                                   _mm256_cmp_ps(d_, best, _CMP_LT_OQ));
+        hit = _mm256_andnot_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(idx, skipv)), hit);
+        best = _mm256_blendv_ps(best, d_, hit);
+        bestIdx = _mm256_castps_si256(_mm256_blendv_ps(_mm256_castsi256_ps(bestIdx),
+                                                       _mm256_castsi256_ps(idx), hit));
+    }
+
+    alignas(32) float dist[8];
+    alignas(32) int lane[8];
+    _mm256_store_ps(dist, best);
+    _mm256_store_si256((__m256i*)lane, bestIdx);
+
+    float dist_ = 1e30;
+    int hit = reduceLanes(dist, lane, 8, dist_);
+    // remaining spheres have higher indices, a strict < keeps the first one
+    hit = closestHitScalar(o, dir, s, skip, dist_, i, hit);
+    if (hit >= 0)
+        d = dist_;
+    return hit;
+}
+
+AVX2 static bool anyHitAvx2(const vec3& o, const vec3& dir, const SphereColumns& s, int skip)
+{
+    __m256 ox = _mm256_set1_ps(o.x), oy = _mm256_set1_ps(o.y), oz = _mm256_set1_ps(o.z);
+    __m256 dx = _mm256_set1_ps(dir.x), dy = _mm256_set1_ps(dir.y), dz = _mm256_set1_ps(dir.z);
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256i skipv = _mm256_set1_epi32(skip);
+    const __m256i step = _mm256_set1_epi32(8);
+    __m256i idx = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+
+    int i = 0;
+    for (; i + 8 <= s.n; i += 8, idx = _mm256_add_epi32(idx, step))
+    {
+        __m256 d_ = intersect8(ox, oy, oz, dx, dy, dz,
+                               _mm256_loadu_ps(s.x + i), _mm256_loadu_ps(s.y + i),
+                               _mm256_loadu_ps(s.z + i), _mm256_loadu_ps(s.r + i));
+        __m256 hit = _mm256_cmp_ps(d_, zero, _CMP_GT_OQ);
+        hit = _mm256_andnot_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(idx, skipv)), hit);
+        if (_mm256_movemask_ps(hit))
+            return true;
+    }
+    if (i == s.n)
+        return false;
+
+    // the last spheres in masked lanes, short lists being all tail
+    __m256i live = _mm256_cmpgt_epi32(_mm256_set1_epi32(s.n - i), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+    __m256 d_ = intersect8(ox, oy, oz, dx, dy, dz,
+                           _mm256_maskload_ps(s.x + i, live), _mm256_maskload_ps(s.y + i, live),
+                           _mm256_maskload_ps(s.z + i, live), _mm256_maskload_ps(s.r + i, live));
+    __m256 hit = _mm256_and_ps(_mm256_cmp_ps(d_, zero, _CMP_GT_OQ), _mm256_castsi256_ps(live));
+    hit = _mm256_andnot_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(idx, skipv)), hit);
+    return _mm256_movemask_ps(hit) != 0;
+}
+
+// 8 rays per pass over the spheres, a lane each
+AVX2 static void closestHitPacketAvx2(const RayColumns& rays, int n, const SphereColumns& s,
+                                      const int* skip, int* hit, float* d)
+{
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256i one = _mm256_set1_epi32(1);
+
+    int k = 0;
+    for (; k + 8 <= n; k += 8)
+    {
+        __m256 ox = _mm256_loadu_ps(rays.ox + k), oy = _mm256_loadu_ps(rays.oy + k);
+        __m256 oz = _mm256_loadu_ps(rays.oz + k), dx = _mm256_loadu_ps(rays.dx + k);
+        __m256 dy = _mm256_loadu_ps(rays.dy + k), dz = _mm256_loadu_ps(rays.dz + k);
+        __m256i skipv = _mm256_loadu_si256((const __m256i*)(skip + k));
+
+        __m256 best = _mm256_set1_ps(1e30f);
+        __m256i bestIdx = _mm256_set1_epi32(-1);
+        __m256i idx = _mm256_setzero_si256();
+        // spheres in order and a strict <: the first of equal distances stays
+        for (int i = 0; i < s.n; ++i, idx = _mm256_add_epi32(idx, one))
+        {
+            __m256 d_ = intersect8(ox, oy, oz, dx, dy, dz, _mm256_set1_ps(s.x[i]), _mm256_set1_ps(s.y[i]),
+                                   _mm256_set1_ps(s.z[i]), _mm256_set1_ps(s.r[i]));
+            __m256 closer = _mm256_and_ps(_mm256_cmp_ps(d_, zero, _CMP_GT_OQ),
+                                          _mm256_cmp_ps(d_, best, _CMP_LT_OQ));
+            closer = _mm256_andnot_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(idx, skipv)), closer);
+            best = _mm256_blendv_ps(best, d_, closer);
+            bestIdx = _mm256_castps_si256(_mm256_blendv_ps(_mm256_castsi256_ps(bestIdx),
+                                                           _mm256_castsi256_ps(idx), closer));
+        }
+
+        alignas(32) float dist[8];
+        _mm256_store_ps(dist, best);
+        _mm256_storeu_si256((__m256i*)(hit + k), bestIdx);
+        for (int l = 0; l < 8; ++l)
+            if (hit[k + l] >= 0)
+                d[k + l] = dist[l];
+    }
+    closestHitPacketScalar(rays, n, s, skip, hit, d, k);
+}
+
+AVX2 static void intersectPacketAvx2(const RayColumns& rays, int n, const vec4& sphere, float* d)
+{
+    __m256 x = _mm256_set1_ps(sphere.x), y = _mm256_set1_ps(sphere.y);
+    __m256 z = _mm256_set1_ps(sphere.z), r = _mm256_set1_ps(sphere.w);
+
+    int i = 0;
+    for (; i + 8 <= n; i += 8)
+        _mm256_storeu_ps(d + i, intersect8(_mm256_loadu_ps(rays.ox + i), _mm256_loadu_ps(rays.oy + i),
+                                           _mm256_loadu_ps(rays.oz + i), _mm256_loadu_ps(rays.dx + i),
+                                           _mm256_loadu_ps(rays.dy + i), _mm256_loadu_ps(rays.dz + i),
+                                           x, y, z, r));
+    intersectPacketScalar(rays, n, sphere, d, i);
+}
+
+/**********/
+/* AVX512 */
+/**********/
+
+#define AVX512 __attribute__((target("avx512f")))
+
+// fragment.glsl's intersect() on 16 lanes
+AVX512 static inline __m512 intersect16(__m512 ox, __m512 oy, __m512 oz,
+                                        __m512 dx, __m512 dy, __m512 dz,
+                                        __m512 x, __m512 y, __m512 z, __m512 r)
+{
+    const __m512 zero = _mm512_setzero_ps();
+    const __m512 miss = _mm512_set1_ps(-1.0f);
+
+    __m512 dvx = _mm512_sub_ps(ox, x);
+    __m512 dvy = _mm512_sub_ps(oy, y);
+    __m512 dvz = _mm512_sub_ps(oz, z);
+    __m512 sqrr = _mm512_mul_ps(r, r);
+    __m512 b = _mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(dx, dvx), _mm512_mul_ps(dy, dvy)),
+                             _mm512_mul_ps(dz, dvz));
+    __m512 dd = _mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(dvx, dvx), _mm512_mul_ps(dvy, dvy)),
+                              _mm512_mul_ps(dvz, dvz));
+    __m512 delta = _mm512_add_ps(_mm512_mul_ps(b, b), _mm512_sub_ps(sqrr, dd));
+
+    __m512 sq = _mm512_maskz_sqrt_ps(0xffff, delta);
+    __m512 nb = _mm512_castsi512_ps(_mm512_xor_si512(_mm512_castps_si512(b),
+                                                       _mm512_set1_epi32(0x80000000)));
+    __m512 d = _mm512_sub_ps(nb, sq);
+    __m512 D = _mm512_add_ps(nb, sq);
+
+    __m512 res = _mm512_mask_blend_ps(_mm512_cmp_ps_mask(D, zero, _CMP_GT_OQ), miss, D);
+    res = _mm512_mask_blend_ps(_mm512_cmp_ps_mask(d, zero, _CMP_GT_OQ), res, d);
+    return _mm512_mask_blend_ps(_mm512_cmp_ps_mask(delta, zero, _CMP_LT_OQ), res, miss);
+}
+
+AVX512 static int closestHitAvx512(const vec3& o, const vec3& dir, const SphereColumns& s,
+                                   int skip, float& d)
+{
+    __m512 ox = _mm512_set1_ps(o.x), oy = _mm512_set1_ps(o.y), oz = _mm512_set1_ps(o.z);
+    __m512 dx = _mm512_set1_ps(dir.x), dy = _mm512_set1_ps(dir.y), dz = _mm512_set1_ps(dir.z);
+    const __m512 zero = _mm512_setzero_ps();
+    const __m512i skipv = _mm512_set1_epi32(skip);
+    const __m512i step = _mm512_set1_epi32(16);
+
+    __m512 best = _mm512_set1_ps(1e30f);
+    __m512i bestIdx = _mm512_set1_epi32(-1);
+    __m512i idx = _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+
+    int i = 0;
+    for (; i + 16 <= s.n; i += 16, idx = _mm512_add_epi32(idx, step))
+    {
+        __m512 d_ = intersect16(ox, oy, oz, dx, dy, dz,
+                                _mm512_loadu_ps(s.x + i), _mm512_loadu_ps(s.y + i),
+                                _mm512_loadu_ps(s.z + i), _mm512_loadu_ps(s.r + i));
+        __mmask16 hit = _mm512_cmp_ps_mask(d_, zero, _CMP_GT_OQ)
+                      & _mm512_cmp_ps_mask(d_, best, _CMP_LT_OQ)
+                      & _mm512_cmpneq_epi32_mask(idx, skipv);
+        best = _mm512_mask_blend_ps(hit, best, d_);
+        bestIdx = _mm512_mask_blend_epi32(hit, bestIdx, idx);
+    }
+
+    alignas(64) float dist[16];
+    alignas(64) int lane[16];
+    _mm512_store_ps(dist, best);
+    _mm512_store_si512(lane, bestIdx);
+
+    float dist_ = 1e30;
+    int hit = reduceLanes(dist, lane, 16, dist_);
+    hit = closestHitScalar(o, dir, s, skip, dist_, i, hit);
+    if (hit >= 0)
+        d = dist_;
+    return hit;
+}
+
+AVX512 static bool anyHitAvx512(const vec3& o, const vec3& dir, const SphereColumns& s, int skip)
+{
+    __m512 ox = _mm512_set1_ps(o.x), oy = _mm512_set1_ps(o.y), oz = _mm512_set1_ps(o.z);
+    __m512 dx = _mm512_set1_ps(dir.x), dy = _mm512_set1_ps(dir.y), dz = _mm512_set1_ps(dir.z);
+    const __m512 zero = _mm512_setzero_ps();
+    const __m512i skipv = _mm512_set1_epi32(skip);
+    const __m512i step = _mm512_set1_epi32(16);
+    __m512i idx = _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+
+    int i = 0;
+    for (; i + 16 <= s.n; i += 16, idx = _mm512_add_epi32(idx, step))
+    {
+        __m512 d_ = intersect16(ox, oy, oz, dx, dy, dz,
+                                _mm512_loadu_ps(s.x + i), _mm512_loadu_ps(s.y + i),
+                                _mm512_loadu_ps(s.z + i), _mm512_loadu_ps(s.r + i));
+        if (_mm512_cmp_ps_mask(d_, zero, _CMP_GT_OQ) & _mm512_cmpneq_epi32_mask(idx, skipv))
+            return true;
+    }
+    if (i == s.n)
+        return false;
+
+    __mmask16 live = (1u << (s.n - i)) - 1;
+    __m512 d_ = intersect16(ox, oy, oz, dx, dy, dz,
+                            _mm512_maskz_loadu_ps(live, s.x + i), _mm512_maskz_loadu_ps(live, s.y + i),
+                            _mm512_maskz_loadu_ps(live, s.z + i), _mm512_maskz_loadu_ps(live, s.r + i));
+    return (_mm512_cmp_ps_mask(d_, zero, _CMP_GT_OQ) & _mm512_cmpneq_epi32_mask(idx, skipv) & live) != 0;
+}
+
+AVX512 static void closestHitPacketAvx512(const RayColumns& rays, int n, const SphereColumns& s,
+                                          const int* skip, int* hit, float* d)
+{
+    const __m512 zero = _mm512_setzero_ps();
+    const __m512i one = _mm512_set1_epi32(1);
+
+    int k = 0;
+    for (; k + 16 <= n; k += 16)
+    {
+        __m512 ox = _mm512_loadu_ps(rays.ox + k), oy = _mm512_loadu_ps(rays.oy + k);
+        __m512 oz = _mm512_loadu_ps(rays.oz + k), dx = _mm512_loadu_ps(rays.dx + k);
+        __m512 dy = _mm512_loadu_ps(rays.dy + k), dz = _mm512_loadu_ps(rays.dz + k);
+        __m512i skipv = _mm512_loadu_si512(skip + k);
+
+        __m512 best = _mm512_set1_ps(1e30f);
+        __m512i bestIdx = _mm512_set1_epi32(-1);
+        __m512i idx = _mm512_setzero_si512();
+        for (int i = 0; i < s.n; ++i, idx = _mm512_add_epi32(idx, one))
+        {
+            __m512 d_ = intersect16(ox, oy, oz, dx, dy, dz, _mm512_set1_ps(s.x[i]), _mm512_set1_ps(s.y[i]),
+                                    _mm512_set1_ps(s.z[i]), _mm512_set1_ps(s.r[i]));
+            __mmask16 closer = _mm512_cmp_ps_mask(d_, zero, _CMP_GT_OQ)
+                             & _mm512_cmp_ps_mask(d_, best, _CMP_LT_OQ)
+                             & _mm512_cmpneq_epi32_mask(idx, skipv);
+            best = _mm512_mask_blend_ps(closer, best, d_);
+            bestIdx = _mm512_mask_blend_epi32(closer, bestIdx, idx);
+        }
+
+        __mmask16 found = _mm512_cmpge_epi32_mask(bestIdx, _mm512_setzero_si512());
+        _mm512_storeu_si512(hit + k, bestIdx);
+        _mm512_mask_storeu_ps(d + k, found, best);
+    }
+    closestHitPacketScalar(rays, n, s, skip, hit, d, k);
+}
+
+AVX512 static void intersectPacketAvx512(const RayColumns& rays, int n, const vec4& sphere, float* d)
+{
+    __m512 x = _mm512_set1_ps(sphere.x), y = _mm512_set1_ps(sphere.y);
+    __m512 z = _mm512_set1_ps(sphere.z), r = _mm512_set1_ps(sphere.w);
+
+    int i = 0;
+    for (; i + 16 <= n; i += 16)
+        _mm512_storeu_ps(d + i, intersect16(_mm512_loadu_ps(rays.ox + i), _mm512_loadu_ps(rays.oy + i),
+                                            _mm512_loadu_ps(rays.oz + i), _mm512_loadu_ps(rays.dx + i),
+                                            _mm512_loadu_ps(rays.dy + i), _mm512_loadu_ps(rays.dz + i),
+                                            x, y, z, r));
+    intersectPacketScalar(rays, n, sphere, d, i);
+}
+
+/************/
+/* DISPATCH */
+/************/
+
+static SimdLevel level = detectSimdLevel();
+
+SimdLevel detectSimdLevel()
+{
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f"))
+        return SIMD_AVX512;
+    if (__builtin_cpu_supports("avx2"))
+        return SIMD_AVX2;
+    return SIMD_SCALAR;
+}
+
+SimdLevel simdLevel()
+{
+    return level;
+}
+
+SimdLevel setSimdLevel(SimdLevel l)
+{
+    level = std::min(l, detectSimdLevel());
+    return level;
+}
+
+const char* simdLevelName(SimdLevel l)
+{
+    switch (l)
+    {
+    case SIMD_AVX512:
+        return "avx512";
+    case SIMD_AVX2:
+        return "avx2";
+    default:
+        return "scalar";
+    }
+}
+
+int closestHit(const vec3& o, const vec3& dir, const SphereColumns& s, int skip, float& d)
+{
+    switch (level)
+    {
+    case SIMD_AVX512:
+        return closestHitAvx512(o, dir, s, skip, d);
+    case SIMD_AVX2:
+        return closestHitAvx2(o, dir, s, skip, d);
+    default:
+        return closestHitScalar(o, dir, s, skip, d);
+    }
+}
+
+bool anyHit(const vec3& o, const vec3& dir, const SphereColumns& s, int skip)
+{
+    switch (level)
+    {
+    case SIMD_AVX512:
+        return anyHitAvx512(o, dir, s, skip);
+    case SIMD_AVX2:
+        return anyHitAvx2(o, dir, s, skip);
+    default:
+        return anyHitScalar(o, dir, s, skip);
+    }
+}
+
+void intersectPacket(const RayColumns& rays, int n, const vec4& sphere, float* d)
+{
+    switch (level)
+    {
+    case SIMD_AVX512:
+        intersectPacketAvx512(rays, n, sphere, d);
+        break;
+    case SIMD_AVX2:
+        intersectPacketAvx2(rays, n, sphere, d);
+        break;
+    default:
+        intersectPacketScalar(rays, n, sphere, d);
+        break;
+    }
+}
+
+void closestHitPacket(const RayColumns& rays, int n, const SphereColumns& s, const int* skip, int* hit, float* d)
+{
+    switch (level)
+    {
+    case SIMD_AVX512:
+        closestHitPacketAvx512(rays, n, s, skip, hit, d);
+        break;
+    case SIMD_AVX2:
+        closestHitPacketAvx2(rays, n, s, skip, hit, d);
+        break;
+    default:
+        closestHitPacketScalar(rays, n, s, skip, hit, d);
+        break;
+    }
+}
@@ -0,0 +1,103 @@
+#ifndef INTERSECT_HPP
+#define INTERSECT_HPP
+
+#include <cmath>
+#include "vec.hpp"
+
+/*
+  Ray/sphere intersection kernels.
+
+  All of them compute exactly what intersect() in fragment.glsl does, in the
+  same order of operations (no fused multiply-add), so the SIMD versions
+  return the same floats as the scalar one: nearest root if positive, else
+  farthest root if positive, else -1.
+
+  The implementation is picked at startup from what CPUID reports.
+*/
+
+// spheres as separate columns (structure of arrays)
+struct SphereColumns
+{
+    const float* x;
+    const float* y;
+    const float* z;
+    const float* r;
+    int n;
+};
+
+// rays as separate columns, origins and directions
+struct RayColumns
+{
+    const float* ox;
+    const float* oy;
+    const float* oz;
+    const float* dx;
+    const float* dy;
+    const float* dz;
+};
+
+// what queries fetched: a packet of rays loads a node or a sphere once for
+// all of them, so coherent packets make fewer fetches per ray
+struct RayStats
+{
+    unsigned long long rays;
+    unsigned long long nodes;       // BVH nodes
+    unsigned long long spheres;     // spheres tested
+
+    void add(const RayStats& s) { rays += s.rays; nodes += s.nodes; spheres += s.spheres; }
+};
+
+enum SimdLevel
+{
+    SIMD_SCALAR,
+    SIMD_AVX2,   // 8 lanes
+    SIMD_AVX512  // 16 lanes
+};
+
+// best level supported by this CPU
+SimdLevel detectSimdLevel();
+// level in use (detectSimdLevel() by default)
+SimdLevel simdLevel();
+// force a level, clamped to what the CPU supports; returns the one in use
+SimdLevel setSimdLevel(SimdLevel level);
+const char* simdLevelName(SimdLevel level);
+
+// the reference, one ray against one sphere
+inline float intersectSphere(const vec3& o, const vec3& dir, float x, float y, float z, float r)
+{
+    vec3 dv = {o.x - x, o.y - y, o.z - z};
+    float sqrr = r * r;
+    float b = dot(dir, dv);
+    float delta = b * b;
+    delta += -dot(dv, dv) + sqrr;
+
+    if (delta < 0)
+        return -1.0f;
+
+    float d = -b - sqrtf(delta);
+    float D = -b + sqrtf(delta);
+
+    if (d > 0)
+        return d;
+    else if (D > 0)
+        return D;
+    else
+        return -1.0f;
+}
+
+// one ray against every sphere but `skip`: index of the closest hit (the
+// lowest index among equal distances, as the GLSL loop) and its distance
+// in d, or -1 when nothing is hit, d being left untouched then
+int closestHit(const vec3& o, const vec3& dir, const SphereColumns& s, int skip, float& d);
+
+// one ray against every sphere but `skip`: whether any of them is hit
+bool anyHit(const vec3& o, const vec3& dir, const SphereColumns& s, int skip);
+
+// n rays against one sphere, distances (or -1) written to d[0..n)
+void intersectPacket(const RayColumns& rays, int n, const vec4& sphere, float* d);
+
+// closestHit() of n rays, ray k skipping sphere skip[k], with a ray per lane:
+// each sphere is loaded once for 8 or 16 rays
+void closestHitPacket(const RayColumns& rays, int n, const SphereColumns& s, const int* skip, int* hit, float* d);
+
+#endif
@@ -1,11 +1,27 @@
 #include <SFML/Window.hpp>
 #include <SFML/Audio.hpp>
-#define GL_GLEXT_PROTOTYPES
-#include <SFML/OpenGL.hpp>
-#include <GL/glext.h>
+#include "gl.hpp"
 #include <iostream>
-#include <fstream>
 #include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <climits>
+#include "vec.hpp"
+#include "scene.hpp"
+#include "raytracer.hpp"
+#include "tiles.hpp"
+#include "bvh.hpp"
+#include "screentiles.hpp"
+#include "upload.hpp"
+#include "timeline.hpp"
+#include "capture.hpp"
+#include "headless.hpp"
+#include "shaders.hpp"
+#include "resolution.hpp"
+#include "profiler.hpp"
+#include "pacer.hpp"
+#include "audioclock.hpp"
 
 /*************/
 /* CONSTANTS */
@@ -14,64 +30,15 @@
 #define WINDOW_WIDTH    800
 #define WINDOW_HEIGHT   600
 
-#define LOG_MAX_LEN     1023
-
 #define FPS             60
 
-#define PI 3.14159265358979323846
-#define DEG2RAD(DEG) ((DEG) * (PI/180.0))
-
-double SPEED =          1.0;
-
-/***********************/
-/* ANIMATION FACILITES */
-/***********************/
-
-#define START() if (tic == 1 && onTic)
-#define ON_TIC(T) else if (tic == T && onTic)
-#define TO_TIC(T) else if (tic <= T)
-#define END() else { exit(0); }
-
-
-float cos_arr[360];
-float sin_arr[360];
-#define COS(DEG) (cos_arr[int(DEG) % 360])
-#define SIN(DEG) (sin_arr[int(DEG) % 360])
-
-#define RAD2DEG(RAD) (180 * RAD / PI)
-
-#define LOAD_COSIN() for(int i = 0; i < 360; ++i) { \
-    cos_arr[i] = cos(DEG2RAD(i));                   \
-    sin_arr[i] = sin(DEG2RAD(i)); }
-
-double getNote(int ms, double BPM, double note)
-{
-    return .5 * COS(RAD2DEG(ms * 2 * PI / (60000 / double(BPM * note)))) + .5;
-}
-
-/*********/
-/* TYPES */
-/*********/
+// linked programs are kept there between launches (see shaders.hpp)
+#define PROGRAM_CACHE   "shadercache"
 
-struct vec2
-{
-    float x;
-    float y;
-};
-struct vec3
-{
-    float x;
-    float y;
-    float z;
-};
-struct vec4
-{
-    float x;
-    float y;
-    float z;
-    float w;
-};
+// from this many spheres on, rays go through a BVH (see bvh.hpp)
+#define BVH_MIN_SPHERES 64
 
+double SPEED =          1.0;
 
 /**********/
 /* GLOBAL */
@@ -84,48 +51,6 @@ unsigned height = WINDOW_HEIGHT;
 /* USEFUL FUNCTIONS */
 /********************/
 
-float norm(const vec3& v)
-{
-    return sqrt(v.x * v.x + v.y * v.y + v.z * v.z);
-}
-vec3 normalize(const vec3& v)
-{
-    vec3 r;
-    float n = norm(v);
-    r.x = v.x / n;
-    r.y = v.y / n;
-    r.z = v.z / n;
-    return r;
-}
-vec3 operator-(const vec3& u, const vec3& v)
-{
-    vec3 w;
-    w.x = u.x - v.x;
-    w.y = u.y - v.y;
-    w.z = u.z - v.z;
-    return w;
-}
-vec3 cross(const vec3& u, const vec3& v)
-{
-    vec3 w;
-    w.x = u.y * v.z - u.z * v.y;
-    w.y = u.z * v.x - u.x * v.z;
-    w.z = u.x * v.y - u.y * v.x;
-    return w;
-}
-
-const char* sourceFromFile(const char* filename)
-{
-    std::ifstream file(filename, std::ios::in|std::ios::binary|std::ios::ate);
-    file.seekg(0, std::ios::end);
-    unsigned size = file.tellg();
-    char *src = new char[size];
-    file.seekg(0, std::ios::beg);
-    file.read(src, size);
-    file.close();
-    return src;
-}
-
 void getCamera(const vec3& origin, const vec3& target, vec3& n, vec3& u, vec3& v, float& focal)
 {
     n = normalize(target - origin);
@@ -155,441 +80,712 @@ void getCamera(const vec3& origin, const vec3& target, vec3& n, vec3& u, vec3& v
     focal = fabs(width / (2.0 * 0.41421356237309503));
 }
 
+// whether a ray can bounce off some sphere
+bool reflective(const SceneStore& scene)
+{
+    const float* reflection = scene.column(SceneStore::REFLECTION);
+    for (unsigned i = 0; i < scene.size(); ++i)
+        if (reflection[i] != 0)
+            return true;
+    return false;
+}
+
+// whole number from min to max, all of text
+bool integer(const char* text, long min, long max, long& value)
+{
+    char* end;
+    errno = 0;
+    value = strtol(text, &end, 10);
+    return end != text && *end == '\0' && errno == 0 && value >= min && value <= max;
+}
+
+int usage(const char* name)
+{
+    std::cout << "usage: " << name << " [--cpu] [--upload-stats] [--bvh] [--bvh-stats]\n"
+              << "       [--render-out out/frame%05d.ppm|.png|out.rgb] [--render-fps N] [--headless]\n"
+              << "       [--variants] [--max-bounces N] [--variant-stats] [--no-program-cache]\n"
+              << "       [--dynamic-resolution] [--profile] [--profile-out profile.csv|trace.json]\n"
+              << "       [--pacing-stats] [--audio-stats] [--start-tic N] [--pin-threads] [--tile-stats]\n"
+              << "       [--pixel-order rows|morton|hilbert] [--packet N] [--wavefront] [--shadow-stats]\n"
+              << "       [--cull-stats]\n";
+    return 1;
+}
+
 /***********/
 /* PROGRAM */
 /***********/
 
-int main()
+int main(int argc, char** argv)
 {
-    LOAD_COSIN();
-
-    // create the window
-    sf::Window window(sf::VideoMode(WINDOW_WIDTH, WINDOW_HEIGHT), "OpenGL", sf::Style::Default, sf::ContextSettings(32));
-    window.setVerticalSyncEnabled(false);
+    // launch to first frame, with and without cached program binaries
+    sf::Clock startup;
+
+    // render on the CPU (see raytracer.hpp) instead of the fragment shader
+    bool cpuRender = false;
+    // print the bytes sent to GL for the scene every second
+    bool uploadStats = false;
+    // use the BVH whatever the number of spheres
+    bool forceBvh = false;
+    // print the BVH refits and rebuilds every second
+    bool bvhStats = false;
+    // print what the occluder lists keep every second
+    bool shadowStats = false;
+    // print what the screen tile lists keep every second
+    bool cullStats = false;
+    // render every frame of the timeline to files instead of playing it
+    const char* renderOut = NULL;
+    unsigned renderFps = FPS;
+    // GL through EGL into an FBO, no window nor display
+    bool headless = false;
+    // a program compiled for the scene shape (see shaders.hpp)
+    bool variants = false;
+    // reflections followed, -1 until the attenuation limit
+    int maxBounces = -1;
+    // print the GPU time of each program at the end
+    bool variantStats = false;
+    // compile the shaders even if their binaries are cached
+    bool programCache = true;
+    // draw at the resolution the GPU keeps up with, upscaled to the window
+    bool dynamicResolution = false;
+    // print where the frame time goes, and write it down as CSV or a trace
+    bool profile = false;
+    const char* profileOut = NULL;
+    // print every second how close to their schedule frames are presented
+    bool pacingStats = false;
+    // print every second how the timeline follows the music
+    bool audioStats = false;
+    // start the show at this tic instead of the beginning
+    unsigned startTic = 0;
+    // keep each CPU renderer thread on its core, print how busy they are
+    bool pinThreads = false;
+    bool tileStats = false;
+    // how the CPU renderer walks the pixels (see raytracer.hpp)
+    TileWalk walk;
+
+    // option argument, checked by integer()
+    long number;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (!strcmp(argv[i], "--cpu"))
+            cpuRender = true;
+        else if (!strcmp(argv[i], "--upload-stats"))
+            uploadStats = true;
+        else if (!strcmp(argv[i], "--bvh"))
+            forceBvh = true;
+        else if (!strcmp(argv[i], "--bvh-stats"))
+            bvhStats = true;
+        else if (!strcmp(argv[i], "--shadow-stats"))
+            shadowStats = true;
+        else if (!strcmp(argv[i], "--cull-stats"))
+            cullStats = true;
+        else if (!strcmp(argv[i], "--render-out") && i + 1 < argc)
+            renderOut = argv[++i];
+        else if (!strcmp(argv[i], "--render-fps") && i + 1 < argc && atoi(argv[i + 1]) > 0)
+            renderFps = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--headless"))
+            headless = true;
+        else if (!strcmp(argv[i], "--variants"))
+            variants = true;
+        else if (!strcmp(argv[i], "--max-bounces") && i + 1 < argc && integer(argv[i + 1], -1, INT_MAX, number))
+        {
+            maxBounces = number;
+            ++i;
+        }
+        else if (!strcmp(argv[i], "--variant-stats"))
+            variantStats = true;
+        else if (!strcmp(argv[i], "--no-program-cache"))
+            programCache = false;
+        else if (!strcmp(argv[i], "--dynamic-resolution"))
+            dynamicResolution = true;
+        else if (!strcmp(argv[i], "--pacing-stats"))
+            pacingStats = true;
+        else if (!strcmp(argv[i], "--pin-threads"))
+            pinThreads = true;
+        else if (!strcmp(argv[i], "--tile-stats"))
+            tileStats = true;
+        else if (!strcmp(argv[i], "--pixel-order") && i + 1 < argc && pixelOrderFromName(argv[i + 1], walk.order))
+            ++i;
+        else if (!strcmp(argv[i], "--packet") && i + 1 < argc && atoi(argv[i + 1]) > 0)
+            walk.packet = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--wavefront"))
+            walk.wavefront = true;
+        else if (!strcmp(argv[i], "--start-tic") && i + 1 < argc && integer(argv[i + 1], 1, INT_MAX, number))
+        {
+            startTic = number;
+            ++i;
+        }
+        else if (!strcmp(argv[i], "--audio-stats"))
+            audioStats = true;
+        else if (!strcmp(argv[i], "--profile"))
+            profile = true;
+        else if (!strcmp(argv[i], "--profile-out") && i + 1 < argc)
+        {
+            profile = true;
+            profileOut = argv[++i];
+        }
+        else
+            return usage(argv[0]);
+    }
 
-    // load resources, initialize the OpenGL states, ...
+    // offline, time goes one frame at a time, whatever the rendering takes
+    bool offline = renderOut != NULL;
+    FrameWriter writer;
+    if (offline && !writer.open(renderOut))
+    {
+        std::cout << renderOut << ": expected out.rgb, or a .ppm or .png numbered by one %d or %u (frame%05d.ppm)\n";
+        return 1;
+    }
 
-    std::cout << (const char*) glGetString(GL_VERSION) << "\n";
-    std::cout << (const char*) glGetString(GL_SHADING_LANGUAGE_VERSION) << "\n";
+    // rendering offline on the CPU needs neither a display nor GL
+    bool useGl = !(offline && cpuRender);
 
-    /*************************/
-    /* SHADER INITIALISATION */
-    /*************************/
+    // offline, every frame takes what it takes
+    if (dynamicResolution && (offline || cpuRender))
+    {
+        std::cout << "--dynamic-resolution only applies to the shader, played live\n";
+        dynamicResolution = false;
+    }
 
-    const char* vsSrc = sourceFromFile("vertex.glsl");
-    const char* fsSrc = sourceFromFile("fragment.glsl");
+    // create the window (or the offscreen context)
+    sf::Window window;
+    HeadlessContext headlessContext;
+    ShaderCache shaders;
+    ShaderCache upscaleShaders;
+    GLuint p = 0;
 
-    int status, len;
-    char* log = new char[LOG_MAX_LEN + 1];
+    CapturePipeline pipeline(writer);
+    double renderTime = 0;
 
-    // compiling vertex shader
-    GLuint v = glCreateShader(GL_VERTEX_SHADER);
-    glShaderSource(v, 1, &vsSrc, NULL);
-    glCompileShader(v);
-    glGetShaderiv(v, GL_COMPILE_STATUS, &status);
-    std::cout << "vertex shader compilation: " << status << "\n";
-    if (!status)
+    if (useGl)
     {
-        std::cout << "===============================\n";
-        glGetShaderInfoLog(v, LOG_MAX_LEN, &len, log);
-        std::cout.write(log, len);
-        std::cout << "===============================\n";
-    }
+        if (headless)
+        {
+            if (!headlessContext.create(WINDOW_WIDTH, WINDOW_HEIGHT))
+                return 1;
+        }
+        else
+        {
+            window.create(sf::VideoMode(WINDOW_WIDTH, WINDOW_HEIGHT), "OpenGL", sf::Style::Default, sf::ContextSettings(32));
+            window.setVerticalSyncEnabled(false);
+        }
 
-    // compiling fragment shader
-    GLuint f = glCreateShader(GL_FRAGMENT_SHADER);
-    glShaderSource(f, 1, &fsSrc, NULL);
-    glCompileShader(f);
-    glGetShaderiv(f, GL_COMPILE_STATUS, &status);
-    std::cout << "fragment shader compilation: " << status << "\n";
-    if (!status)
-    {
-        std::cout << "===============================\n";
-        glGetShaderInfoLog(f, LOG_MAX_LEN, &len, log);
-        std::cout.write(log, len);
-        std::cout << "===============================\n";
-    }
+        // load resources, initialize the OpenGL states, ...
+
+        std::cout << (const char*) glGetString(GL_VERSION) << "\n";
+        std::cout << (const char*) glGetString(GL_SHADING_LANGUAGE_VERSION) << "\n";
 
-    // creating and linking shader program
-    GLuint p = glCreateProgram();
-    glAttachShader(p, v);
-    glAttachShader(p, f);
-    glLinkProgram(p);
-    glGetShaderiv(f, GL_LINK_STATUS, &status);
-    std::cout << "program linking: " << status << "\n";
-    if (!status)
-        exit(0);
+        /*************************/
+        /* SHADER INITIALISATION */
+        /*************************/
 
-    // using program from now
-    glUseProgram(p);
+        if (!shaders.init("vertex.glsl", "fragment.glsl", programCache ? PROGRAM_CACHE : NULL))
+            exit(0);
+        // the generic one, until the scene has a shape
+        p = shaders.program(ShaderVariant());
+        if (!p)
+            exit(0);
+    }
+
+    // resolution the shader draws at
+    ResolutionGovernor governor(WINDOW_WIDTH, WINDOW_HEIGHT, 1000.0 / FPS);
+    ScaledTarget scaledTarget;
+    GpuTimer gpuTimer;
 
+    if (dynamicResolution)
+    {
+        GLuint upscale = 0;
+        if (upscaleShaders.init("vertex.glsl", "upscale.glsl", programCache ? PROGRAM_CACHE : NULL))
+            upscale = upscaleShaders.program(ShaderVariant());
+        if (!upscale || !gpuTimer.init())
+        {
+            std::cout << "--dynamic-resolution needs upscale.glsl and GPU timer queries (GL 3.3)\n";
+            exit(0);
+        }
+        // after the six units of the scene (see upload.hpp)
+        scaledTarget.init(WINDOW_WIDTH, WINDOW_HEIGHT, upscale, 6);
+    }
+    else if (variantStats && useGl)
+        gpuTimer.init();
+    bool resized = false;
 
-    // settings uniform constants
-    glUniform2f(glGetUniformLocation(p, "resolution"), WINDOW_WIDTH, WINDOW_HEIGHT);
+    Profiler profiler;
+    if (profile)
+        profiler.init(useGl);
 
     /******************/
     /* MUSIC MAESTRO! */
     /******************/
 
-    sf::Music music;
-    music.openFromFile("music.ogg");
-    music.setPitch(SPEED);
-    music.play();
+    // the animation (camera, scene and lights)
+    Timeline timeline;
+    if (!timeline.load("timeline.txt"))
+        return 1;
+    if (startTic > timeline.lastTic())
+        return usage(argv[0]);
+    // ms of music the show starts at
+    double startTime = timeline.ticTime(startTic);
 
-    // tempo
-    int BPM = 129;
+    sf::Music music;
+    if (!offline)
+    {
+        music.openFromFile("music.ogg");
+        music.setPitch(SPEED);
+        music.play();
+        if (startTime > 0)
+            music.setPlayingOffset(sf::milliseconds(startTime));
+    }
 
     // and time
     sf::Clock clock;
-    sf::Time lastTime = clock.getElapsedTime();
+    FramePacer pacer(FPS);
+    // live, the timeline follows the music (see audioclock.hpp)
+    AudioClock audioClock(SPEED);
 
     /******************/
     /* USED VARIABLES */
     /******************/
 
     // camera
-    vec3 cameraOrigin;
-    vec3 cameraTarget;
     vec3 U, V, cameraNormal;
     float focal;
 
-    GLuint normalLoc = glGetUniformLocation(p, "normal");
-    GLuint originLoc = glGetUniformLocation(p, "origin");
-    GLuint uLoc = glGetUniformLocation(p, "u");
-    GLuint vLoc = glGetUniformLocation(p, "v");
-    GLuint focalLoc = glGetUniformLocation(p, "focal");
-
-    // objects
-    unsigned    objectsNb = 0;
-    vec4        spheres[100];
-    vec3        colors[100];
-    vec3        attributes[100];
-
-    GLuint objectsNbLoc = glGetUniformLocation(p, "objNb");
-    GLuint spheresLoc = glGetUniformLocation(p, "spheres");
-    GLuint colorsLoc = glGetUniformLocation(p, "colors");
-    GLuint attrLoc = glGetUniformLocation(p, "attr");
-
-    // lights
-    float       ambientLight = .5;
-    unsigned    lightsNb = 0;
-    vec4        lights[10];
+    GLint resolutionLoc = -1, normalLoc = -1, originLoc = -1, uLoc = -1, vLoc = -1, focalLoc = -1, ambientLoc = -1;
+
+    // objects and lights
+    SceneStore  scene;
+    SceneUploader uploader;
+    UploadStats uploadShown = UploadStats();
+
+    Bvh         bvh;
+    BvhStats    bvhShown = BvhStats();
+    OccluderLists occluders;
+    OccluderStats occludersShown = OccluderStats();
+    ScreenTiles screenTiles;
+    ScreenTileStats screenTilesShown = ScreenTileStats();
+
+    // using program q from now, its uniforms being set again
+    auto useProgram = [&](GLuint q) {
+        p = q;
+        glUseProgram(p);
+
+        // settings uniform constants
+        glUniform1i(glGetUniformLocation(p, "maxBounces"), maxBounces);
+
+        resolutionLoc = glGetUniformLocation(p, "resolution");
+        glUniform2f(resolutionLoc, governor.width(), governor.height());
+        normalLoc = glGetUniformLocation(p, "normal");
+        originLoc = glGetUniformLocation(p, "origin");
+        uLoc = glGetUniformLocation(p, "u");
+        vLoc = glGetUniformLocation(p, "v");
+        focalLoc = glGetUniformLocation(p, "focal");
+        ambientLoc = glGetUniformLocation(p, "ambientLight");
+    };
+
+    // what is drawn: the shader over the whole screen, or the CPU's pixels
+    ScreenTriangle screenTriangle;
+    PixelBlit pixelBlit;
+
+    if (useGl)
+    {
+        useProgram(p);
+        screenTriangle.init();
+        pixelBlit.init(WINDOW_WIDTH, WINDOW_HEIGHT);
+        uploader.init(p);
+        std::cout << "scene upload: " << (uploader.persistent() ? "persistent mapping" : "glBufferSubData") << "\n";
+    }
 
-    GLuint ambientLoc = glGetUniformLocation(p, "ambientLight");
-    GLuint lightsNbLoc = glGetUniformLocation(p, "lNb");
-    GLuint lightsLoc = glGetUniformLocation(p, "lights");
+    // same data, seen by the CPU renderer, and its threads (none but this one on the GPU)
+    Scene cpuScene;
+    Framebuffer framebuffer;
+    TileRenderer tiles(cpuRender ? 0 : 1, pinThreads);
+    tiles.setWalk(walk);
+    cpuScene.resolution = {WINDOW_WIDTH, WINDOW_HEIGHT};
+    cpuScene.store = &scene;
+    cpuScene.bvh = NULL;
+    cpuScene.occluders = NULL;
+    cpuScene.screenTiles = NULL;
+    cpuScene.maxBounces = maxBounces;
+
+    if (offline)
+        pipeline.start(WINDOW_WIDTH, WINDOW_HEIGHT, !cpuRender);
 
     /*************/
     /* MAIN LOOP */
     /*************/
 
-    unsigned tic = 0; // tempo indicator
-    bool onTic = false; // on tempo indicator
-    double t = 1, t_; // bpm indicator (and previous)
-    // int u = (60000 / (BPM)); // bpm factor
-    double T = 0; // real time in ms
+    double T = 0; // music time in ms
+    unsigned frame = 0;
 
     bool running = true;
     bool firstTime = true;
-    bool updateCamera = false;
-    bool updateScene = false;
-    bool updateLights = false;
+    // shape of the last frame, the program is looked up when it changes
+    ShaderVariant shape;
+    bool mirrors = false;
 
     while (running)
     {
-        sf::Time time = clock.getElapsedTime();
-
-        if ((time - lastTime).asMilliseconds() < (1000 / FPS))
-            continue;
+        double frameStart = clock.getElapsedTime().asSeconds();
 
-        // double u = (time - lastTime).asMilliseconds();
-        // if (u > 0)
-        //     std::cout << 1000 / u << "\n";
-
-        lastTime = time;
-
-        // clear the buffers
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-        // compute time and tempo
-        T = time.asMilliseconds() * SPEED;
-        t = getNote(T, BPM, 1) - .5;
-
-        onTic = false;
-        if (t_ > 0 && t < 0)
+        if (offline)
+            T = startTime + frame * 1000.0 / renderFps * SPEED;
+        else
         {
-            // std::cout << tic << "\n";
-            onTic = true;
-            ++tic;
+            pacer.wait();
+            bool musicPlaying = music.getStatus() == sf::Music::Playing;
+            T = audioClock.update(clock.getElapsedTime().asMicroseconds() * 1e-6,
+                                  musicPlaying ? music.getPlayingOffset().asMicroseconds() / 1000.0 : -1);
         }
-        t_ = t;
-
-        updateScene = false;
-        updateCamera = false;
-        updateLights = false;
-
-        START() {
-
-            lightsNb = 1;
-            lights[0] = {0,0,0, 1.0};
-
-            cameraOrigin = {0,0,-4000};
-            cameraTarget = {0,0,0};
-
-            objectsNb = 1;
 
-            spheres[0] = {0,0,0, 1000};
-            colors[0] = {.6, .6, .6};
-            attributes[0] = {.8, 1.0, 16};
+        profiler.beginFrame();
 
-            objectsNb = 19;
-            for (int i = 0; i < 18; ++i)
-            {
-                float c = COS(i * 20);
-                float s = SIN(i * 20);
-                spheres[i+1] = {1400 * c, 0, 1400 * s, 100};
-                colors[i+1] = {1,1,0};
-                attributes[i+1] = {.7,.5,16};
-            }
-
-            updateCamera = true;
-            updateScene = true;
+        // clear the buffers
+        if (useGl)
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-        } TO_TIC (10) {
+        profiler.begin(Profiler::TIMELINE);
+        bool playing = timeline.step(T, scene);
+        profiler.end(Profiler::TIMELINE);
+        if (!playing)
+            break;
 
-            for (int i = 0; i < 18; ++i)
-            {
-                float c = COS(i * 20 + double(T) / 50);
-                float s = SIN(i * 20 + double(T) / 50);
-                spheres[i+1].x = 1400 * c;
-                spheres[i+1].z = 1400 * s;
-            }
+        profiler.begin(Profiler::UPLOAD);
 
-            updateScene = true;
+        // the program for this shape, compiled the first time it shows up
+        bool newProgram = false;
+        if (variants && useGl && !cpuRender && (timeline.updateScene || timeline.updateLights || firstTime))
+        {
+            // lights alone do not change the reflections
+            if (timeline.updateScene || firstTime)
+                mirrors = reflective(scene);
 
-        } TO_TIC (22) {
+            ShaderVariant variant;
+            variant.spheres = scene.size();
+            variant.lights = scene.lightsSize();
+            // with no mirror, one bounce renders as many as the attenuation allows
+            variant.bounces = mirrors ? maxBounces : 0;
 
-            for (int i = 0; i < 18; ++i)
+            if (variant != shape)
             {
-                float c = COS(i * 20 + double(T) / 50);
-                float s = SIN(i * 20 + double(T) / 50);
-                spheres[i+1].x = 1400 * c;
-                spheres[i+1].z = 1400 * s;
-                spheres[i+1].y += 5;
+                shape = variant;
+                GLuint q = shaders.program(variant);
+                if (q && q != p)
+                {
+                    useProgram(q);
+                    uploader.setProgram(q);
+                    newProgram = true;
+                }
             }
+        }
 
-            updateScene = true;
-
-        } ON_TIC (23) {
+        const vec3& cameraOrigin = timeline.cameraOrigin;
 
-            for (int i = 0; i < 18; ++i)
-            {
-                float c = COS(i * 20);
-                float s = SIN(i * 20);
-                spheres[i+1] = {1400 * c, 1400 * s, 0, 100};
-                colors[i+1] = {1,1,0};
-                attributes[i+1] = {.7,.5,16};
-            }
+        if (resized)
+            glUniform2f(resolutionLoc, governor.width(), governor.height());
 
-        } TO_TIC (31) {
-
-            for (int i = 0; i < 18; ++i)
+        if (timeline.updateCamera || firstTime || newProgram || resized)
+        {
+            getCamera(cameraOrigin, timeline.cameraTarget, cameraNormal, U, V, focal);
+            if (useGl)
             {
-                float c = COS(i * 20 + double(T) / 50);
-                float s = SIN(i * 20 + double(T) / 50);
-                spheres[i+1].x = 1400 * c;
-                spheres[i+1].y = 1400 * s;
+                glUniform3f(originLoc, cameraOrigin.x, cameraOrigin.y, cameraOrigin.z);
+                glUniform3f(normalLoc, cameraNormal.x, cameraNormal.y, cameraNormal.z);
+                // fewer pixels, each one standing for several of the window
+                vec3 u = (float(WINDOW_WIDTH) / governor.width()) * U;
+                vec3 v = (float(WINDOW_HEIGHT) / governor.height()) * V;
+                glUniform3f(uLoc, u.x, u.y, u.z);
+                glUniform3f(vLoc, v.x, v.y, v.z);
+                glUniform1f(focalLoc, focal);
             }
+        }
 
-            updateScene = true;
-
-        } ON_TIC (32) {
-
-            for (int i = 0; i < 18; ++i)
+        if (timeline.updateScene || firstTime)
+        {
+            // refitted to the moving spheres, rebuilt when it got too loose
+            bool useBvh = forceBvh || scene.size() >= BVH_MIN_SPHERES;
+            if (useBvh)
             {
-                float c = COS(i * 20);
-                float s = SIN(i * 20);
-                spheres[i+1] = {1400 * c, 0, 1400 * s, 100};
-                colors[i+1] = {1,1,0};
-                attributes[i+1] = {.7,.5,16};
+                bool built = bvh.update(scene);
+                if (useGl)
+                    uploader.uploadBvh(bvh, built);
             }
-
-            cameraOrigin = {0, 2000,-4000};
-            updateCamera = true;
-            updateScene = true;
-
-        } TO_TIC (38) {
-
-            for (int i = 0; i < 18; ++i)
+            else if (!bvh.empty())
             {
-                float c = COS(i * 20 + double(T) / 50);
-                float s = SIN(i * 20 + double(T) / 50);
-                spheres[i+1].x = 1400 * c;
-                spheres[i+1].z = 1400 * s;
+                bvh.clear();
+                if (useGl)
+                    uploader.uploadBvh(bvh);
             }
+            cpuScene.bvh = bvh.empty() ? NULL : &bvh;
 
-            updateScene = true;
-
-        } ON_TIC (39) {
-
-            cameraOrigin = {-2000, -2000,-4000};
-            updateCamera = true;
-
-        } TO_TIC (45) {
-
-            for (int i = 0; i < 18; ++i)
-            {
-                float c = COS(i * 20 + double(T) / 50);
-                float s = SIN(i * 20 + double(T) / 50);
-                spheres[i+1].x = 1400 * c;
-                spheres[i+1].z = 1400 * s;
-            }
+            if (useGl)
+                uploader.uploadSpheres(scene);
+        }
 
-            updateScene = true;
+        if ((timeline.updateLights || firstTime || newProgram) && useGl)
+        {
+            glUniform1f(ambientLoc, timeline.ambientLight);
+            uploader.uploadLights(scene);
+        }
 
-        } ON_TIC (46) {
+        // what shadow rays test per light, only without a BVH
+        if (timeline.updateScene || timeline.updateLights || firstTime)
+        {
+            if (bvh.empty())
+                occluders.build(scene);
+            else
+                occluders.clear();
+            cpuScene.occluders = occluders.empty() ? NULL : &occluders;
+            if (useGl)
+                uploader.uploadOccluders(occluders);
+        }
 
-            for (int i = 0; i < 18; ++i)
+        // what primary rays test per screen tile, only without a BVH; the
+        // shader's tiles are those of the pixels it draws
+        if (timeline.updateCamera || timeline.updateScene || firstTime || resized)
+        {
+            Scene view = cpuScene;
+            view.origin = cameraOrigin;
+            view.normal = cameraNormal;
+            view.u = U;
+            view.v = V;
+            view.focal = focal;
+            if (!cpuRender)
             {
-                float c = COS(i * 20);
-                float s = SIN(i * 20);
-                spheres[i+1] = {1400 * c, 1400 * s, 0, 100};
-                attributes[i+1] = {.7,.5,16};
+                view.resolution = {float(governor.width()), float(governor.height())};
+                view.u = (float(WINDOW_WIDTH) / governor.width()) * U;
+                view.v = (float(WINDOW_HEIGHT) / governor.height()) * V;
             }
+            if (bvh.empty())
+                screenTiles.build(view);
+            else
+                screenTiles.clear();
+            cpuScene.screenTiles = screenTiles.empty() ? NULL : &screenTiles;
+            if (useGl)
+                uploader.uploadScreenTiles(screenTiles);
+        }
+        profiler.end(Profiler::UPLOAD);
 
-        } TO_TIC (63) {
+        profiler.begin(Profiler::DRAW);
+        if (cpuRender)
+        {
+            cpuScene.origin = cameraOrigin;
+            cpuScene.normal = cameraNormal;
+            cpuScene.u = U;
+            cpuScene.v = V;
+            cpuScene.focal = focal;
+            cpuScene.ambientLight = timeline.ambientLight;
+            tiles.render(cpuScene, framebuffer);
+
+            if (useGl)
+                pixelBlit.draw(&framebuffer.pixels[0]);
+        }
+        else
+        {
+            gpuTimer.begin(p);
+            if (dynamicResolution)
+                scaledTarget.begin(governor.width(), governor.height());
+            if (variantStats)
+                shaders.beginDraw(p);
+            screenTriangle.draw();
+            if (variantStats)
+                shaders.endDraw();
+            if (dynamicResolution)
+                scaledTarget.end(screenTriangle);
+            gpuTimer.end();
+        }
+        profiler.end(Profiler::DRAW);
 
-            for (int i = 0; i < 18; ++i)
+        // GPU times of the frames before
+        resized = false;
+        double gpuSeconds;
+        GLuint timed;
+        while (gpuTimer.result(gpuSeconds, timed))
+        {
+            shaders.drawTime(timed, gpuSeconds);
+            if (dynamicResolution && governor.update(gpuSeconds * 1e3))
             {
-                float c = COS(i * 20 + double(T) / 50);
-                float s = SIN(i * 20 + double(T) / 50);
-                spheres[i+1].x = 1400 * c;
-                spheres[i+1].y = 1400 * s;
+                resized = true;
+                std::cout << "resolution: " << governor.width() << "x" << governor.height()
+                          << " (" << gpuSeconds * 1e3 << " ms on the GPU)\n";
             }
+        }
 
-            updateScene = true;
-
-        } ON_TIC (64) {
-
-            for (int i = 0; i < 18; ++i)
+        if (offline)
+        {
+            renderTime += clock.getElapsedTime().asSeconds() - frameStart;
+
+            // read back while the next frames render, written on the side
+            profiler.begin(Profiler::CAPTURE);
+            if (cpuRender)
+                pipeline.push(framebuffer);
+            else
+                pipeline.capture();
+            profiler.end(Profiler::CAPTURE);
+            if (pipeline.failed())
             {
-                float c = COS(i * 20);
-                float s = SIN(i * 20);
-                spheres[i+1] = {1400 * c, 0, 1400 * s, 100};
-                colors[i+1] = {1,1,0};
-                attributes[i+1] = {.7,.5,16};
+                std::cout << renderOut << ": " << pipeline.error() << "\n";
+                return 1;
             }
+            if (frame && frame % renderFps == 0)
+                std::cout << "rendered " << T / 1000 << " s (" << frame / clock.getElapsedTime().asSeconds()
+                          << " frames/s)\n";
+        }
 
-            cameraOrigin = {0, 0,-4000};
-            updateCamera = true;
-            updateScene = true;
-
-        } TO_TIC (70) {
-
-            for (int i = 0; i < 18; ++i)
+        ++frame;
+        if (useGl)
+            uploader.endFrame();
+        if (uploadStats && useGl && frame % FPS == 0)
+        {
+            const UploadStats& s = uploader.total();
+            std::cout << "upload: " << (s.bytes - uploadShown.bytes) / FPS << " bytes/frame ("
+                      << (s.fullBytes - uploadShown.fullBytes) / FPS << " for whole blocks), "
+                      << s.stalls - uploadShown.stalls << " stalls\n";
+            uploadShown = s;
+        }
+        if (tileStats && cpuRender && frame % FPS == 0)
+        {
+            TileStats s = tiles.takeStats();
+            std::cout << "tiles: " << s.tileSize << "px, busy";
+            for (const TileWorkerStats& w : s.workers)
+                std::cout << " " << int(100 * w.busy / s.time) << "%";
+            unsigned steals = 0;
+            RayStats rays = RayStats(), primary = RayStats();
+            for (const TileWorkerStats& w : s.workers)
             {
-                float c = COS(i * 20 + double(T) / 50);
-                float s = SIN(i * 20 + double(T) / 50);
-                spheres[i+1].x = 1400 * c;
-                spheres[i+1].z = 1400 * s;
-                float color = getNote(T, BPM, 1);
-                colors[i+1] = {1, 1-color, color};
+                steals += w.steals;
+                rays.add(w.rays);
+                primary.add(w.primary);
             }
-
-            updateScene = true;
-
-        } TO_TIC (200) {
-
-            for (int i = 0; i < 18; ++i)
+            std::cout << ", " << steals / s.frames << " steals/frame, per ray "
+                      << double(rays.nodes) / std::max(rays.rays, 1ULL) << " nodes "
+                      << double(rays.spheres) / std::max(rays.rays, 1ULL) << " spheres (primary "
+                      << double(primary.nodes) / std::max(primary.rays, 1ULL) << " and "
+                      << double(primary.spheres) / std::max(primary.rays, 1ULL) << ")\n";
+            if (walk.wavefront)
             {
-                float c = COS(i * 20 + double(T) / 50);
-                float s = SIN(i * 20 + double(T) / 50);
-                spheres[i+1].x = 1400 * c;
-                spheres[i+1].z = 1400 * s;
-                float color = getNote(T, BPM, 1);
-                colors[i+1] = {1, 1-color, color};
+                // rays through each stage per second of the workers' time in it
+                WavefrontStats stages = WavefrontStats();
+                for (const TileWorkerStats& w : s.workers)
+                    stages.add(w.stages);
+                std::cout << "wavefront:";
+                for (int i = 0; i < WAVE_STAGES; ++i)
+                    std::cout << (i ? ", " : " ") << waveStageName(WaveStage(i)) << " "
+                              << stages.rays[i] / std::max(stages.time[i], 1e-9) / 1e6 << " Mrays/s";
+                std::cout << "\n";
             }
-
-            // cameraOrigin.x = 4000 * getNote(T, BPM, 8);
-            // cameraOrigin.y += 2;
-            // cameraOrigin.z = -4000 * SIN(T / 100);
-
-            updateCamera = true;
-            updateScene = true;
-
-        // } ON_TIC (101) {
-
-        //     for (int i = 0; i < 18; ++i)
-        //     {
-        //         float c = COS(i * 20);
-        //         float s = SIN(i * 20);
-        //         spheres[i+1] = {1400 * c, 1400 * s, 0, 100};
-        //         colors[i+1] = {1,1,0};
-        //         attributes[i+1] = {.7,.5,16};
-        //     }
-
-        // } TO_TIC (120) {
-
-        //     for (int i = 0; i < 18; ++i)
-        //     {
-        //         float c = COS(i * 20 + double(T) / 50);
-        //         float s = SIN(i * 20 + double(T) / 50);
-        //         spheres[i+1].x = 1400 * c;
-        //         spheres[i+1].y = 1400 * s;
-        //     }
-
-        //     updateScene = true;
-
-
-
-        } END();
-
-        if (updateCamera)
+        }
+        if (bvhStats && frame % FPS == 0)
         {
-            updateLights = true;
-            lights[0].x = cameraOrigin.x;
-            lights[0].y = cameraOrigin.y;
-            lights[0].z = cameraOrigin.z;
+            const BvhStats& s = bvh.stats();
+            unsigned refits = s.refits - bvhShown.refits;
+            unsigned builds = s.builds - bvhShown.builds;
+            std::cout << "bvh: " << refits << " refits ("
+                      << (refits ? (s.refitTime - bvhShown.refitTime) / refits * 1e3 : 0) << " ms), "
+                      << builds << " builds ("
+                      << (builds ? (s.buildTime - bvhShown.buildTime) / builds * 1e3 : 0) << " ms), cost "
+                      << bvh.cost() << " for " << bvh.buildCost() << " when built\n";
+            bvhShown = s;
+        }
+        if (shadowStats && frame % FPS == 0)
+        {
+            const OccluderStats& s = occluders.stats();
+            unsigned builds = s.builds - occludersShown.builds;
+            unsigned long long spheres = s.spheres - occludersShown.spheres;
+            std::cout << "shadows: " << builds << " occluder lists ("
+                      << (builds ? (s.time - occludersShown.time) / builds * 1e3 : 0) << " ms), "
+                      << (spheres ? 100.0 * (s.candidates - occludersShown.candidates) / spheres : 100)
+                      << "% of the spheres tested per light\n";
+            occludersShown = s;
+        }
+        if (cullStats && frame % FPS == 0)
+        {
+            const ScreenTileStats& s = screenTiles.stats();
+            unsigned builds = s.builds - screenTilesShown.builds;
+            unsigned long long tiles = s.tiles - screenTilesShown.tiles;
+            std::cout << "culling: " << builds << " screen tile lists ("
+                      << (builds ? (s.time - screenTilesShown.time) / builds * 1e3 : 0) << " ms), "
+                      << (tiles ? double(s.candidates - screenTilesShown.candidates) / tiles : 0)
+                      << " spheres per tile for " << scene.size() << "\n";
+            screenTilesShown = s;
         }
 
-        if (updateCamera || firstTime)
+        // end the current frame (internally swaps the front and back buffers)
+        if (useGl && !headless)
         {
-            getCamera(cameraOrigin, cameraTarget, cameraNormal, U, V, focal);
-            glUniform3f(originLoc, cameraOrigin.x, cameraOrigin.y, cameraOrigin.z);
-            glUniform3f(normalLoc, cameraNormal.x, cameraNormal.y, cameraNormal.z);
-            glUniform3f(uLoc, U.x, U.y, U.z);
-            glUniform3f(vLoc, V.x, V.y, V.z);
-            glUniform1f(focalLoc, focal);
+            profiler.begin(Profiler::SWAP);
+            window.display();
+            profiler.end(Profiler::SWAP);
         }
+        if (!offline)
+            pacer.presented();
+        if (pacingStats && !offline && frame % FPS == 0)
+        {
+            PacerStats s = pacer.takeStats();
+            unsigned n = std::max(s.frames, 1u);
+            std::cout << "pacing: woke " << s.wake / n * 1e6 << " us late (max " << s.wakeMax * 1e6
+                      << "), presented " << FramePacer::mean(s) * 1e3 << " ms after the deadline +- "
+                      << FramePacer::jitter(s) * 1e3 << ", " << s.missed << " missed, "
+                      << 100 * s.spin / (s.sleep + s.spin + 1e-9) << "% of the wait spinning\n";
+        }
+        if (audioStats && !offline && frame % FPS == 0)
+        {
+            AudioClockStats s = audioClock.takeStats();
+            std::cout << "audio: drift " << s.error << " ms (max " << s.errorMax << "), rate "
+                      << (s.rate / SPEED - 1) * 1e6 << " ppm off, " << s.correction << " ms corrected, "
+                      << s.resyncs << " resyncs, " << s.gaps << " underruns (" << s.gapTime << " ms)\n";
+        }
+        profiler.endFrame();
+        if (profile && frame % Profiler::WINDOW == 0)
+            profiler.report();
 
-        if (updateScene || firstTime)
+        if (firstTime)
         {
-            glUniform1i(objectsNbLoc, objectsNb);
-            glUniform4fv(spheresLoc, objectsNb, (float*)spheres);
-            glUniform3fv(colorsLoc, objectsNb, (float*)colors);
-            glUniform3fv(attrLoc, objectsNb, (float*)attributes);
+            if (useGl)
+                glFinish();
+            std::cout << "first frame after " << startup.getElapsedTime().asMilliseconds() << " ms\n";
+            firstTime = false;
         }
+    }
 
-        if (updateLights || firstTime)
+    if (offline)
+    {
+        if (!pipeline.finish())
         {
-            glUniform1f(ambientLoc, ambientLight);
-            glUniform1i(lightsNbLoc, lightsNb);
-            glUniform4fv(lightsLoc, lightsNb, (float*)lights);
+            std::cout << renderOut << ": " << pipeline.error() << "\n";
+            return 1;
         }
 
-        glBegin(GL_TRIANGLE_STRIP);
-            glVertex3f(-1, 1, 1);
-            glVertex3f(1, 1, 1);
-            glVertex3f(-1, -1, 1);
-            glVertex3f(1, -1, 1);
-        glEnd();
+        // average and worst latency of each stage, in ms
+        CaptureStats s = pipeline.stats();
+        unsigned n = std::max(s.frames, 1u);
+        std::cout << writer.frames() << " frames written in " << clock.getElapsedTime().asSeconds() << " s\n"
+                  << "  render: " << renderTime / n * 1e3 << " ms\n";
+        if (!cpuRender)
+            std::cout << "  readback: " << s.readback / n * 1e3 << " ms (max " << s.readbackMax * 1e3
+                      << "), blocked " << s.readbackWait / n * 1e3 << " ms, " << s.stalls << " stalls\n";
+        std::cout << "  write: " << s.encode / n * 1e3 << " ms (max " << s.encodeMax * 1e3
+                  << "), " << s.waits << " frames waited " << s.queueWait * 1e3 << " ms for the writer\n";
+    }
 
+    if (profile)
+    {
+        profiler.finish();
+        profiler.report();
 
-        // end the current frame (internally swaps the front and back buffers)
-        window.display();
+        const char* ext = profileOut ? strrchr(profileOut, '.') : NULL;
+        bool json = ext && !strcmp(ext, ".json");
+        if (profileOut && !(json ? profiler.writeTrace(profileOut) : profiler.writeCsv(profileOut)))
+            std::cout << profileOut << ": write error\n";
+    }
 
-        if (firstTime)
-            firstTime = false;
+    if (variantStats && useGl)
+    {
+        double gpuSeconds;
+        GLuint timed;
+        while (gpuTimer.result(gpuSeconds, timed, true))
+            shaders.drawTime(timed, gpuSeconds);
+
+        std::cout << "programs:\n";
+        shaders.report();
     }
 
     // release resources...
@@ -0,0 +1,122 @@
+#include "occluders.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+static double now()
+{
+    using namespace std::chrono;
+    return duration<double>(steady_clock::now().time_since_epoch()).count();
+}
+
+// a sphere seen from the light, radius widened by the margin
+struct Cone
+{
+    double x, y, z;     // unit direction from the light
+    double dist;        // to the center
+    double radius;
+    double angle;       // half angle
+    bool around;        // the light is inside: any direction
+};
+
+OccluderLists::OccluderLists() : spheres_(0), stats_()
+{
+}
+
+void OccluderLists::build(const SceneStore& scene)
+{
+    double start = now();
+    unsigned n = scene.size();
+    unsigned lights = scene.lightsSize();
+
+    spheres_ = n;
+    offsets_.assign(1, 0);
+    indices_.clear();
+    x_.clear();
+    y_.clear();
+    z_.clear();
+    r_.clear();
+    slots_.assign(lights * n, -1);
+
+    std::vector<Cone> cones(n);
+    for (unsigned l = 0; l < lights; ++l)
+    {
+        vec4 light = scene.light(l);
+        for (unsigned i = 0; i < n; ++i)
+        {
+            vec4 sp = scene.sphere(i);
+            Cone& c = cones[i];
+            double dx = sp.x - light.x, dy = sp.y - light.y, dz = sp.z - light.z;
+            c.dist = sqrt(dx * dx + dy * dy + dz * dz);
+            c.radius = sp.w + OCCLUDER_MARGIN * c.dist;
+            c.around = c.dist <= c.radius;
+            if (c.around)
+                continue;
+            c.x = dx / c.dist;
+            c.y = dy / c.dist;
+            c.z = dz / c.dist;
+            c.angle = asin(c.radius / c.dist);
+        }
+
+        // j is kept if it is in the cones of some other sphere i
+        for (unsigned j = 0; j < n; ++j)
+        {
+            const Cone& o = cones[j];
+            bool candidate = false;
+            for (unsigned i = 0; i < n && !candidate; ++i)
+            {
+                if (i == j)
+                    continue;
+                const Cone& c = cones[i];
+                if (c.around || o.around)
+                {
+                    candidate = true;
+                    break;
+                }
+                double cosine = std::min(std::max(c.x * o.x + c.y * o.y + c.z * o.z, -1.0), 1.0);
+                double angle = acos(cosine);
+                double spread = c.angle + o.angle;
+                // toward i, up to its far side
+                candidate = angle <= spread && o.dist * cosine - o.radius <= c.dist + c.radius;
+                // past the light
+                candidate |= M_PI - angle <= spread;
+            }
+            if (!candidate)
+                continue;
+
+            vec4 sp = scene.sphere(j);
+            slots_[l * n + j] = indices_.size() - offsets_[l];
+            indices_.push_back(j);
+            x_.push_back(sp.x);
+            y_.push_back(sp.y);
+            z_.push_back(sp.z);
+            r_.push_back(sp.w);
+        }
+        offsets_.push_back(indices_.size());
+    }
+
+    stats_.builds += 1;
+    stats_.time += now() - start;
+    stats_.candidates += indices_.size();
+    stats_.spheres += lights * n;
+}
+
+void OccluderLists::clear()
+{
+    spheres_ = 0;
+    offsets_.clear();
+    indices_.clear();
+    x_.clear();
+    y_.clear();
+    z_.clear();
+    r_.clear();
+    slots_.clear();
+}
+
+SphereColumns OccluderLists::columns(unsigned l) const
+{
+    int first = offsets_[l];
+    SphereColumns c = {x_.data() + first, y_.data() + first, z_.data() + first, r_.data() + first,
+                       offsets_[l + 1] - first};
+    return c;
+}
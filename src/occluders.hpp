@@ -0,0 +1,69 @@
+#ifndef OCCLUDERS_HPP
+#define OCCLUDERS_HPP
+
+#include <vector>
+#include "intersect.hpp"
+#include "scene.hpp"
+
+/*
+  Per light, the spheres a shadow ray toward it can meet.
+
+  A shadow ray leaves a point of sphere i toward the light and goes on past
+  it: from the light, it stays within the cone around sphere i (on the side
+  of i, no farther than i's far side) or the opposite cone (past the light).
+  A sphere that is in none of these cones, for any other sphere i, can never
+  shadow anything from that light and is left out of its list. Every sphere
+  counts as seen, directly or in a reflection.
+
+  The cones are widened by OCCLUDER_MARGIN radians so that grazing rays,
+  rounded in float, never miss a sphere the full test would hit: shadows
+  are the same with or without the lists.
+
+  Lists are built once per frame, in O(lights x spheres^2); they are used
+  without a BVH, whose walk already skips what is far from each ray.
+*/
+
+#define OCCLUDER_MARGIN     1e-3
+
+// what the builds cost and culled
+struct OccluderStats
+{
+    unsigned builds;
+    double time;                    // s, all builds
+    unsigned long long candidates;  // kept, all lights of all builds
+    unsigned long long spheres;     // lights x spheres, all builds
+};
+
+class OccluderLists
+{
+public:
+    OccluderLists();
+
+    void build(const SceneStore& scene);
+    void clear();
+
+    bool empty() const { return offsets_.empty(); }
+    unsigned lights() const { return offsets_.empty() ? 0 : offsets_.size() - 1; }
+
+    // candidates of light l, for anyHit(), and where sphere i is in them
+    // (-1 if it is not one)
+    SphereColumns columns(unsigned l) const;
+    int slot(unsigned l, int i) const { return slots_[l * spheres_ + i]; }
+
+    // light l's candidates are indices()[offsets()[l], offsets()[l + 1])
+    const std::vector<int>& offsets() const { return offsets_; }
+    const std::vector<int>& indices() const { return indices_; }
+
+    const OccluderStats& stats() const { return stats_; }
+
+private:
+    unsigned spheres_;
+    std::vector<int> offsets_;
+    std::vector<int> indices_;
+    std::vector<float> x_, y_, z_, r_;  // the candidates, light after light
+    std::vector<int> slots_;            // lights x spheres
+
+    OccluderStats stats_;
+};
+
+#endif
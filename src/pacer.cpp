@@ -0,0 +1,86 @@
+#include "pacer.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <thread>
+
+// bounds of the spin before each deadline, s
+#define MIN_MARGIN      .0002
+#define MAX_MARGIN      .002
+
+static double now()
+{
+    using namespace std::chrono;
+    return duration<double>(steady_clock::now().time_since_epoch()).count();
+}
+
+FramePacer::FramePacer(double fps)
+    : period_(1 / fps), start_(-1), next_(0), deadline_(0), margin_(MAX_MARGIN), stats_()
+{
+}
+
+void FramePacer::wait()
+{
+    double t = now();
+    if (start_ < 0)
+        start_ = t;
+
+    // too late for the next deadline already: the following one
+    deadline_ = start_ + next_ * period_;
+    if (t > deadline_ + period_)
+    {
+        unsigned long skipped = (unsigned long)((t - start_) / period_) + 1 - next_;
+        stats_.missed += skipped;
+        next_ += skipped;
+        deadline_ = start_ + next_ * period_;
+    }
+    ++next_;
+
+    // coarse sleep, then how far past its target it woke up sets the margin
+    double target = deadline_ - margin_;
+    if (t < target)
+    {
+        std::this_thread::sleep_for(std::chrono::duration<double>(target - t));
+        double woke = now();
+        stats_.sleep += woke - t;
+        // up at once after a late wake-up, down slowly
+        margin_ = std::min(std::max(std::max(.98 * margin_, 1.5 * (woke - target)), MIN_MARGIN), MAX_MARGIN);
+        t = woke;
+    }
+
+    double spinStart = t;
+    while (t < deadline_)
+        t = now();
+    stats_.spin += t - spinStart;
+
+    stats_.wake += t - deadline_;
+    stats_.wakeMax = std::max(stats_.wakeMax, t - deadline_);
+    ++stats_.frames;
+}
+
+void FramePacer::presented()
+{
+    double d = now() - deadline_;
+    stats_.present += d;
+    stats_.presentSquares += d * d;
+}
+
+PacerStats FramePacer::takeStats()
+{
+    PacerStats s = stats_;
+    stats_ = PacerStats();
+    return s;
+}
+
+double FramePacer::mean(const PacerStats& s)
+{
+    return s.frames ? s.present / s.frames : 0;
+}
+
+double FramePacer::jitter(const PacerStats& s)
+{
+    if (!s.frames)
+        return 0;
+    double m = mean(s);
+    return sqrt(std::max(s.presentSquares / s.frames - m * m, 0.0));
+}
@@ -0,0 +1,54 @@
+#ifndef PACER_HPP
+#define PACER_HPP
+
+/*
+  Frame pacing for the live demo.
+
+  Frames are due every 1 / fps s from the first wait(), on a steady clock
+  with microsecond resolution. wait() sleeps until shortly before the next
+  deadline and spins only over the last slice, whose length follows how
+  late the sleeps have been waking up. A frame later than a whole period
+  is dropped from the schedule rather than rushed to catch up.
+
+  The stats compare each deadline with the moment the loop woke up and
+  with the moment the frame was presented.
+*/
+
+struct PacerStats
+{
+    unsigned frames;
+    unsigned missed;        // deadlines skipped, the frame before being too late
+    double wake;            // s past the deadlines at wake-up, summed
+    double wakeMax;
+    double present;         // s from the deadlines to presented(), summed
+    double presentSquares;  // and squared, for the jitter
+    double sleep;           // s spent sleeping
+    double spin;            // s spent spinning
+};
+
+class FramePacer
+{
+public:
+    explicit FramePacer(double fps);
+
+    // returns once the next frame is due
+    void wait();
+    // the frame is on screen
+    void presented();
+
+    // since the last call
+    PacerStats takeStats();
+    // mean and standard deviation of present - deadline, in s
+    static double mean(const PacerStats& s);
+    static double jitter(const PacerStats& s);
+
+private:
+    double period_;
+    double start_;      // s, first wait()
+    unsigned long next_; // index of the next deadline
+    double deadline_;   // of the current frame
+    double margin_;     // s spun before each deadline
+    PacerStats stats_;
+};
+
+#endif
@@ -0,0 +1,246 @@
+#include "profiler.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+static double now()
+{
+    using namespace std::chrono;
+    return duration<double>(steady_clock::now().time_since_epoch()).count();
+}
+
+static const Profiler::Pass GPU_PASSES[] = {
+    Profiler::FRAME, Profiler::UPLOAD, Profiler::DRAW, Profiler::CAPTURE, Profiler::SWAP
+};
+
+const char* Profiler::name(Pass pass)
+{
+    static const char* names[PASSES] = {"frame", "timeline", "upload", "draw", "capture", "swap"};
+    return names[pass];
+}
+
+Profiler::Profiler()
+    : enabled_(false), gpu_(false), cpuOrigin_(0), gpuOrigin_(0), slots_(), current_(0)
+{
+}
+
+void Profiler::init(bool gpu)
+{
+    enabled_ = true;
+    gpu_ = gpu && (hasGlVersion(3, 3) || hasGlExtension("GL_ARB_timer_query"));
+    if (gpu_)
+    {
+        for (Slot& s : slots_)
+            glGenQueries(2 * PASSES, &s.queries[0][0]);
+        glGetInteger64v(GL_TIMESTAMP, &gpuOrigin_);
+    }
+    cpuOrigin_ = now();
+}
+
+/*************/
+/* RECORDING */
+/*************/
+
+void Profiler::beginFrame()
+{
+    if (!enabled_)
+        return;
+
+    // the oldest frame in flight, done by now unless the GPU is FRAMES behind
+    Slot& s = slots_[current_];
+    if (s.pending)
+        resolve(s, true);
+
+    Record r;
+    for (unsigned p = 0; p < PASSES; ++p)
+        r.cpu[p] = r.gpu[p] = Span{-1, -1};
+    records_.push_back(r);
+
+    s.record = records_.size() - 1;
+    s.pending = gpu_;
+    std::fill(s.used, s.used + PASSES, false);
+
+    begin(FRAME);
+}
+
+void Profiler::begin(Pass pass)
+{
+    if (!enabled_)
+        return;
+
+    records_.back().cpu[pass].start = now() - cpuOrigin_;
+
+    Slot& s = slots_[current_];
+    if (gpu_ && std::count(GPU_PASSES, GPU_PASSES + sizeof(GPU_PASSES) / sizeof(*GPU_PASSES), pass))
+    {
+        glQueryCounter(s.queries[pass][0], GL_TIMESTAMP);
+        s.used[pass] = true;
+    }
+}
+
+void Profiler::end(Pass pass)
+{
+    if (!enabled_)
+        return;
+
+    Slot& s = slots_[current_];
+    if (s.used[pass])
+        glQueryCounter(s.queries[pass][1], GL_TIMESTAMP);
+
+    records_.back().cpu[pass].end = now() - cpuOrigin_;
+}
+
+void Profiler::endFrame()
+{
+    if (!enabled_)
+        return;
+
+    end(FRAME);
+    current_ = (current_ + 1) % FRAMES;
+
+    // whatever older frames the GPU finished
+    for (unsigned k = 0; k < FRAMES; ++k)
+    {
+        Slot& s = slots_[(current_ + k) % FRAMES];
+        if (s.pending)
+            resolve(s, false);
+    }
+}
+
+void Profiler::finish()
+{
+    if (!enabled_ || records_.empty())
+        return;
+
+    // its FRAME query never went
+    if (records_.back().cpu[FRAME].end < 0)
+    {
+        records_.pop_back();
+        slots_[current_].pending = false;
+    }
+    for (Slot& s : slots_)
+        if (s.pending)
+            resolve(s, true);
+}
+
+void Profiler::resolve(Slot& slot, bool wait)
+{
+    // the last query of the frame tells for all the others
+    GLint available = wait;
+    if (!wait)
+        glGetQueryObjectiv(slot.queries[FRAME][1], GL_QUERY_RESULT_AVAILABLE, &available);
+    if (!available)
+        return;
+
+    Record& r = records_[slot.record];
+    for (unsigned p = 0; p < PASSES; ++p)
+    {
+        if (!slot.used[p])
+            continue;
+        GLuint64 t[2];
+        glGetQueryObjectui64v(slot.queries[p][0], GL_QUERY_RESULT, &t[0]);
+        glGetQueryObjectui64v(slot.queries[p][1], GL_QUERY_RESULT, &t[1]);
+        r.gpu[p].start = (GLint64(t[0]) - gpuOrigin_) * 1e-9;
+        r.gpu[p].end = (GLint64(t[1]) - gpuOrigin_) * 1e-9;
+    }
+    slot.pending = false;
+}
+
+/*************/
+/* REPORTING */
+/*************/
+
+// p-th percentile of the durations in ms, -1 if there are none
+static double percentile(std::vector<double>& d, double p)
+{
+    if (d.empty())
+        return -1;
+    size_t i = std::min(d.size() - 1, size_t(p * d.size()));
+    std::nth_element(d.begin(), d.begin() + i, d.end());
+    return d[i];
+}
+
+void Profiler::report()
+{
+    size_t first = records_.size() > WINDOW ? records_.size() - WINDOW : 0;
+
+    // formatted apart, so that cout keeps its precision
+    std::ostringstream out;
+    out << "profile, last " << records_.size() - first << " frames, ms\n"
+        << "                    p50     p95     p99\n" << std::fixed << std::setprecision(2);
+    for (unsigned p = 0; p < PASSES; ++p)
+        for (int gpu = 0; gpu < 2; ++gpu)
+        {
+            std::vector<double> d;
+            for (size_t i = first; i < records_.size(); ++i)
+            {
+                const Span& s = gpu ? records_[i].gpu[p] : records_[i].cpu[p];
+                if (s.start >= 0 && s.end >= 0)
+                    d.push_back((s.end - s.start) * 1e3);
+            }
+            if (d.empty())
+                continue;
+
+            out << "  " << std::left << std::setw(10) << name(Pass(p)) << (gpu ? "gpu" : "cpu")
+                << std::right;
+            for (double q : {.5, .95, .99})
+                out << std::setw(8) << percentile(d, q);
+            out << "\n";
+        }
+    std::cout << out.str();
+}
+
+bool Profiler::writeCsv(const char* path)
+{
+    FILE* f = fopen(path, "w");
+    if (!f)
+        return false;
+
+    // start of the frame then each pass's duration, in ms
+    fprintf(f, "frame,start");
+    for (unsigned p = 0; p < PASSES; ++p)
+        fprintf(f, ",%s_cpu,%s_gpu", name(Pass(p)), name(Pass(p)));
+    fprintf(f, "\n");
+
+    for (size_t i = 0; i < records_.size(); ++i)
+    {
+        const Record& r = records_[i];
+        fprintf(f, "%zu,%.3f", i, r.cpu[FRAME].start * 1e3);
+        for (unsigned p = 0; p < PASSES; ++p)
+            for (const Span* s : {&r.cpu[p], &r.gpu[p]})
+                if (s->start >= 0 && s->end >= 0)
+                    fprintf(f, ",%.3f", (s->end - s->start) * 1e3);
+                else
+                    fprintf(f, ",");
+        fprintf(f, "\n");
+    }
+    return fclose(f) == 0;
+}
+
+bool Profiler::writeTrace(const char* path)
+{
+    FILE* f = fopen(path, "w");
+    if (!f)
+        return false;
+
+    // complete events ("X"), in us
+    fprintf(f, "{\"traceEvents\":[\n"
+               "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,\"args\":{\"name\":\"CPU\"}},\n"
+               "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":2,\"args\":{\"name\":\"GPU\"}}");
+    for (size_t i = 0; i < records_.size(); ++i)
+        for (unsigned p = 0; p < PASSES; ++p)
+            for (int gpu = 0; gpu < 2; ++gpu)
+            {
+                const Span& s = gpu ? records_[i].gpu[p] : records_[i].cpu[p];
+                if (s.start < 0 || s.end < 0)
+                    continue;
+                fprintf(f, ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,"
+                           "\"ts\":%.1f,\"dur\":%.1f,\"args\":{\"frame\":%zu}}",
+                        name(Pass(p)), gpu ? "gpu" : "cpu", gpu + 1, s.start * 1e6, (s.end - s.start) * 1e6, i);
+            }
+    fprintf(f, "\n]}\n");
+    return fclose(f) == 0;
+}
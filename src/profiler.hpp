@@ -0,0 +1,98 @@
+#ifndef PROFILER_HPP
+#define PROFILER_HPP
+
+#include <vector>
+#include "gl.hpp"
+
+/*
+  Where the frame time goes.
+
+  Each pass of a frame is timed on the CPU (steady clock between begin()
+  and end()) and, for those sent to GL, on the GPU: a GL_TIMESTAMP query
+  (glQueryCounter) at both ends tells when the GPU got through the commands
+  issued before it. The queries of a frame are read FRAMES frames later,
+  when they are long done, so that measuring never waits for the GPU.
+
+  Every frame is kept: report() prints the p50/p95/p99 of each pass over
+  the last WINDOW frames, and the whole run can be written as CSV (one row
+  per frame) or as a Chrome trace (chrome://tracing, or ui.perfetto.dev) with
+  the CPU and the GPU as two threads.
+*/
+
+class Profiler
+{
+public:
+    enum Pass
+    {
+        FRAME,          // the whole of it, between beginFrame() and endFrame()
+        TIMELINE,       // animation step (CPU only)
+        UPLOAD,         // uniforms, scene and BVH
+        DRAW,
+        CAPTURE,        // offline readback
+        SWAP,
+        PASSES
+    };
+
+    // frames of queries in flight
+    static const unsigned FRAMES = 3;
+    // frames the percentiles are over
+    static const unsigned WINDOW = 600;
+
+    Profiler();
+
+    // nothing is recorded before; gpu: time the passes on the GPU too
+    // (GL 3.3 or ARB_timer_query, ignored without them)
+    void init(bool gpu);
+    bool enabled() const { return enabled_; }
+
+    void beginFrame();
+    void begin(Pass pass);
+    void end(Pass pass);
+    void endFrame();
+    // waits for the frames in flight; one begun and not ended is dropped
+    void finish();
+
+    unsigned frames() const { return records_.size(); }
+    void report();
+
+    // the whole run, false if it cannot be written
+    bool writeCsv(const char* path);
+    bool writeTrace(const char* path);
+
+    static const char* name(Pass pass);
+
+private:
+    // s since init(), negative for a pass not run (or not timed on the GPU)
+    struct Span
+    {
+        double start;
+        double end;
+    };
+
+    struct Record
+    {
+        Span cpu[PASSES];
+        Span gpu[PASSES];
+    };
+
+    // the queries of a frame in flight
+    struct Slot
+    {
+        GLuint queries[PASSES][2];
+        bool used[PASSES];
+        unsigned record;    // index in records_
+        bool pending;
+    };
+
+    void resolve(Slot& slot, bool wait);
+
+    bool enabled_;
+    bool gpu_;
+    double cpuOrigin_;
+    GLint64 gpuOrigin_;     // ns, GL time at cpuOrigin_
+    Slot slots_[FRAMES];
+    unsigned current_;      // slot of the frame being recorded
+    std::vector<Record> records_;
+};
+
+#endif
@@ -0,0 +1,404 @@
+#include "raytracer.hpp"
+#include "tiles.hpp"
+#include "screentiles.hpp"
+#include <algorithm>
+#include <cstring>
+
+void Framebuffer::resize(unsigned w, unsigned h)
+{
+    width = w;
+    height = h;
+    pixels.resize(w * h * 4);
+}
+
+/*************************/
+/* PORT OF FRAGMENT.GLSL */
+/*************************/
+
+float intersect(const Scene& sc, const vec3& o, const vec3& dir, int i)
+{
+    const SceneStore& st = *sc.store;
+    return intersectSphere(o, dir, st.column(SceneStore::X)[i], st.column(SceneStore::Y)[i],
+                           st.column(SceneStore::Z)[i], st.column(SceneStore::R)[i]);
+}
+
+vec3 reflect(const vec3& a, const vec3& dir, vec3 n)
+{
+    if (dot(dir, n) > 0)
+        n = -n;
+
+    return 2 * dot(dir, n) * n - dir;
+}
+
+int sceneClosestHit(const Scene& sc, const vec3& o, const vec3& dir, const SphereColumns& s, int skip,
+                    float& d, RayStats* stats)
+{
+    if (sc.bvh)
+        return sc.bvh->closestHit(o, dir, s, skip, d, stats);
+    if (stats)
+    {
+        stats->rays += 1;
+        stats->spheres += s.n;
+    }
+    return closestHit(o, dir, s, skip, d);
+}
+
+bool sceneAnyHit(const Scene& sc, const vec3& o, const vec3& dir, const SphereColumns& s, int skip,
+                 unsigned light, RayStats* stats)
+{
+    if (sc.bvh)
+        return sc.bvh->anyHit(o, dir, s, skip, stats);
+    if (sc.occluders)
+    {
+        SphereColumns candidates = sc.occluders->columns(light);
+        if (stats)
+        {
+            stats->rays += 1;
+            stats->spheres += candidates.n;
+        }
+        return anyHit(o, dir, candidates, sc.occluders->slot(light, skip));
+    }
+    if (stats)
+    {
+        stats->rays += 1;
+        stats->spheres += s.n;
+    }
+    return anyHit(o, dir, s, skip);
+}
+
+void hitPoint(const Scene& sc, const vec3& a, const vec3& dir, int o, float d, vec3& inter, vec3& n, vec3& s)
+{
+    vec4 sp = sc.store->sphere(o);
+    // intersection point
+    inter = a + d * dir;
+    // object's normal at the intersection
+    n = normalize(inter - vec3{sp.x, sp.y, sp.z});
+    // reflected ray
+    s = reflect(a, dir, n);
+}
+
+vec3 lightDir(const Scene& sc, const vec3& p, unsigned l)
+{
+    vec4 light = sc.store->light(l);
+    return normalize(p - vec3{light.x, light.y, light.z});
+}
+
+void addLight(const Scene& sc, int i, const vec3& n, const vec3& s, unsigned l, const vec3& lDir, vec3& color)
+{
+    const SceneStore& st = *sc.store;
+    vec3 attr = st.attr(i);
+    vec3 col = st.color(i);
+    float intensity = st.light(l).w;
+
+    // compute diffusion
+    float NdotL = std::max(dot(n, lDir), 0.0f);
+    color = color + (attr.x * intensity * NdotL) * col;
+
+    // compute specularity
+    float SdotL = std::max(dot(s, lDir), 0.0f);
+    color = color + (attr.y * intensity * powf(SdotL, attr.z)) * col;
+}
+
+vec3 surfaceColor(const Scene& sc, int i, vec3 color)
+{
+    color.x = std::min(std::max(color.x, 0.0f), 1.0f);
+    color.y = std::min(std::max(color.y, 0.0f), 1.0f);
+    color.z = std::min(std::max(color.z, 0.0f), 1.0f);
+
+    // ambient lighting
+    return color + sc.ambientLight * sc.store->color(i);
+}
+
+vec3 addBounce(const Scene& sc, const vec3& color, int from, const vec3& hitColor)
+{
+    if (from == -1)
+        return hitColor;
+    return color + sc.store->attr(from).y * hitColor;
+}
+
+bool reflects(const Scene& sc, int o, int bounce, float attenuation)
+{
+    return (sc.maxBounces < 0 || bounce < sc.maxBounces) && sc.store->column(SceneStore::REFLECTION)[o] != 0
+        && attenuation < ATTENUATION_LIMIT;
+}
+
+vec3 compColor(const Scene& sc, const vec3& a, const vec3& dir, const vec3& inter,
+               const vec3& normal, const vec3& s, int i, RayStats* stats)
+{
+    vec3 color = {0, 0, 0};
+    SphereColumns spheres = sc.store->sphereColumns();
+
+    for (unsigned l = 0; l < sc.store->lightsSize(); ++l)
+    {
+        vec3 lDir = lightDir(sc, inter, l);
+
+        // compute shadow
+        if (!sceneAnyHit(sc, inter, -lDir, spheres, i, l, stats))
+            addLight(sc, i, normal, s, l, lDir, color);
+    }
+
+    return surfaceColor(sc, i, color);
+}
+
+vec3 castRay(const Scene& sc, const vec3& a_, const vec3& dir_, RayStats* stats)
+{
+    float d = 1e30;
+    int o = sceneClosestHit(sc, a_, dir_, sc.store->sphereColumns(), -1, d, stats);
+    return castRay(sc, a_, dir_, o, d, stats);
+}
+
+vec3 castRay(const Scene& sc, const vec3& a_, const vec3& dir_, int o, float d, RayStats* stats)
+{
+    int curObj = -1;
+    vec3 color = {0, 0, 0};
+
+    vec3 a = a_;
+    vec3 dir = dir_;
+    float attenuation = 0;
+
+    SphereColumns spheres = sc.store->sphereColumns();
+
+    for (int bounce = 0;; ++bounce)
+    {
+        // the first hit is given
+        if (bounce > 0)
+        {
+            d = 1e30;
+            o = sceneClosestHit(sc, a, dir, spheres, curObj, d, stats);
+        }
+
+        if (o < 0)
+            break;
+
+        attenuation += d;
+        if (attenuation > ATTENUATION_LIMIT)
+            break;
+
+        vec3 inter, n, s;
+        hitPoint(sc, a, dir, o, d, inter, n, s);
+
+        color = addBounce(sc, color, curObj, compColor(sc, a, dir, inter, n, s, o, stats));
+        if (!reflects(sc, o, bounce, attenuation))
+            break;
+
+        curObj = o;
+        a = inter;
+        dir = -s;
+    }
+
+    return color;
+}
+
+void primaryRay(const Scene& sc, unsigned x, unsigned y, vec3& a, vec3& dir)
+{
+    // same as p in fragment.glsl, gl_FragCoord being the pixel center
+    float px = x + .5f - sc.resolution.x / 2;
+    float py = y + .5f - sc.resolution.y / 2;
+
+    // ray to launch from this pixel
+    a = sc.origin + px * sc.u + py * sc.v;
+    dir = normalize(a - (sc.origin - sc.focal * sc.normal));
+}
+
+int primaryHit(const Scene& sc, unsigned x, unsigned y, const vec3& a, const vec3& dir, float& d,
+               RayStats* stats)
+{
+    if (sc.bvh || !sc.screenTiles)
+        return sceneClosestHit(sc, a, dir, sc.store->sphereColumns(), -1, d, stats);
+
+    unsigned t = sc.screenTiles->tile(x, y);
+    SphereColumns candidates = sc.screenTiles->columns(t);
+    if (stats)
+    {
+        stats->rays += 1;
+        stats->spheres += candidates.n;
+    }
+    int k = closestHit(a, dir, candidates, -1, d);
+    return k < 0 ? -1 : sc.screenTiles->sphere(t, k);
+}
+
+vec3 shadePixel(const Scene& sc, unsigned x, unsigned y, RayStats* stats)
+{
+    vec3 a, dir;
+    primaryRay(sc, x, y, a, dir);
+    float d = 1e30;
+    int o = primaryHit(sc, x, y, a, dir, d, stats);
+    return castRay(sc, a, dir, o, d, stats);
+}
+
+/*************/
+/* TRAVERSAL */
+/*************/
+
+const char* pixelOrderName(PixelOrder order)
+{
+    static const char* names[] = {"rows", "morton", "hilbert"};
+    return names[order];
+}
+
+bool pixelOrderFromName(const char* name, PixelOrder& order)
+{
+    for (int o = 0; o < ORDERS; ++o)
+        if (!strcmp(name, pixelOrderName(PixelOrder(o))))
+        {
+            order = PixelOrder(o);
+            return true;
+        }
+    return false;
+}
+
+void curvePoint(PixelOrder order, unsigned side, unsigned i, unsigned& x, unsigned& y)
+{
+    if (order == ORDER_ROWS)
+    {
+        x = i % side;
+        y = i / side;
+    }
+    else if (order == ORDER_MORTON)
+    {
+        // even bits are x, odd bits y
+        x = y = 0;
+        for (unsigned b = 0; (1u << b) < side; ++b)
+        {
+            x |= ((i >> (2 * b)) & 1) << b;
+            y |= ((i >> (2 * b + 1)) & 1) << b;
+        }
+    }
+    else
+    {
+        // quadrant by quadrant from the smallest, rotating as the curve does
+        x = y = 0;
+        for (unsigned s = 1, t = i; s < side; s *= 2, t /= 4)
+        {
+            unsigned rx = 1 & (t / 2);
+            unsigned ry = 1 & (t ^ rx);
+            if (ry == 0)
+            {
+                if (rx == 1)
+                {
+                    x = s - 1 - x;
+                    y = s - 1 - y;
+                }
+                std::swap(x, y);
+            }
+            x += s * rx;
+            y += s * ry;
+        }
+    }
+}
+
+/*************/
+/* RENDERING */
+/*************/
+
+// float to normalized byte, the way GL stores a fragment color in RGBA8
+static unsigned char toByte(float c)
+{
+    c = std::min(std::max(c, 0.0f), 1.0f);
+    return (unsigned char)(c * 255.0f + .5f);
+}
+
+void setPixel(Framebuffer& fb, unsigned x, unsigned y, const vec3& c)
+{
+    unsigned char* px = &fb.pixels[(y * fb.width + x) * 4];
+    px[0] = toByte(c.x);
+    px[1] = toByte(c.y);
+    px[2] = toByte(c.z);
+    px[3] = 255;
+}
+
+// primary rays of n pixels, the first hits found together through the BVH
+struct Packet
+{
+    unsigned x[Bvh::MAX_PACKET];
+    unsigned y[Bvh::MAX_PACKET];
+    float ox[Bvh::MAX_PACKET], oy[Bvh::MAX_PACKET], oz[Bvh::MAX_PACKET];
+    float dx[Bvh::MAX_PACKET], dy[Bvh::MAX_PACKET], dz[Bvh::MAX_PACKET];
+    int n;
+};
+
+static void shadePacket(const Scene& sc, Framebuffer& fb, const Packet& p, RayStats* stats, RayStats* primary)
+{
+    RayColumns rays = {p.ox, p.oy, p.oz, p.dx, p.dy, p.dz};
+    SphereColumns spheres = sc.store->sphereColumns();
+    int hit[Bvh::MAX_PACKET];
+    float d[Bvh::MAX_PACKET];
+
+    RayStats first = RayStats();
+    for (int k = 0; k < p.n; ++k)
+        d[k] = 1e30;
+    sc.bvh->closestHitPacket(rays, p.n, spheres, hit, d, &first);
+    if (stats)
+        stats->add(first);
+    if (primary)
+        primary->add(first);
+
+    for (int k = 0; k < p.n; ++k)
+    {
+        vec3 a = {p.ox[k], p.oy[k], p.oz[k]};
+        vec3 dir = {p.dx[k], p.dy[k], p.dz[k]};
+        setPixel(fb, p.x[k], p.y[k], castRay(sc, a, dir, hit[k], d[k], stats));
+    }
+}
+
+void renderTile(const Scene& sc, Framebuffer& fb, unsigned x0, unsigned y0, unsigned x1, unsigned y1,
+                const TileWalk& walk, RayStats* stats, RayStats* primary)
+{
+    // the curve covers a power of 2 square, what falls out of the tile is skipped
+    unsigned side = 1;
+    while (side < x1 - x0 || side < y1 - y0)
+        side *= 2;
+    // without a BVH, closestHit() already tests 8 or 16 spheres at once for
+    // a ray, which a packet looping over its rays for each sphere only slows
+    int size = sc.bvh ? std::min(std::max(int(walk.packet), 1), Bvh::MAX_PACKET) : 1;
+
+    Packet p;
+    p.n = 0;
+    for (unsigned i = 0; i < side * side; ++i)
+    {
+        unsigned x, y;
+        curvePoint(walk.order, side, i, x, y);
+        x += x0;
+        y += y0;
+        if (x >= x1 || y >= y1)
+            continue;
+
+        vec3 a, dir;
+        primaryRay(sc, x, y, a, dir);
+
+        if (size == 1)
+        {
+            RayStats first = RayStats();
+            float d = 1e30;
+            int o = primaryHit(sc, x, y, a, dir, d, &first);
+            if (stats)
+                stats->add(first);
+            if (primary)
+                primary->add(first);
+            setPixel(fb, x, y, castRay(sc, a, dir, o, d, stats));
+            continue;
+        }
+
+        p.x[p.n] = x;
+        p.y[p.n] = y;
+        p.ox[p.n] = a.x;
+        p.oy[p.n] = a.y;
+        p.oz[p.n] = a.z;
+        p.dx[p.n] = dir.x;
+        p.dy[p.n] = dir.y;
+        p.dz[p.n] = dir.z;
+        if (++p.n == size)
+        {
+            shadePacket(sc, fb, p, stats, primary);
+            p.n = 0;
+        }
+    }
+    if (p.n)
+        shadePacket(sc, fb, p, stats, primary);
+}
+
+void renderFrame(const Scene& sc, Framebuffer& fb, unsigned threads)
+{
+    TileRenderer renderer(threads);
+    renderer.render(sc, fb);
+}
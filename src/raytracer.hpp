@@ -0,0 +1,151 @@
+#ifndef RAYTRACER_HPP
+#define RAYTRACER_HPP
+
+#include <vector>
+#include "vec.hpp"
+#include "intersect.hpp"
+#include "scene.hpp"
+#include "bvh.hpp"
+#include "occluders.hpp"
+
+class ScreenTiles;
+
+/*
+  CPU port of fragment.glsl.
+
+  Every function here mirrors its GLSL counterpart line for line, so a frame
+  rendered by renderFrame() is comparable pixel by pixel with the one the
+  shader draws for the same uniforms.
+*/
+
+// the uniforms of fragment.glsl
+struct Scene
+{
+    vec2 resolution;
+
+    // camera settings
+    vec3 origin;
+    vec3 normal;
+    vec3 u;
+    vec3 v;
+    float focal;
+
+    // objects and lights (objNb, spheres, colors, attr, lNb, lights)
+    const SceneStore* store;
+    // built over store, NULL to test every sphere (bvhSize = 0)
+    const Bvh* bvh;
+    // without a BVH, what shadow rays test per light, NULL for every sphere
+    const OccluderLists* occluders;
+    // without a BVH, what primary rays test per screen tile, NULL for every sphere
+    const ScreenTiles* screenTiles;
+    // reflections followed, -1 until the attenuation limit
+    int maxBounces;
+
+    float ambientLight;
+};
+
+// RGBA8 pixels, bottom row first (as glReadPixels/glDrawPixels expect them)
+struct Framebuffer
+{
+    unsigned width;
+    unsigned height;
+    std::vector<unsigned char> pixels;
+
+    Framebuffer() : width(0), height(0) {}
+    void resize(unsigned w, unsigned h);
+};
+
+// tile size the renderer starts from, see tiles.hpp
+#define TILE_SIZE       16
+
+// distance a ray (with its reflections) goes before it stops
+#define ATTENUATION_LIMIT 10000
+
+float intersect(const Scene& sc, const vec3& o, const vec3& dir, int i);
+// closestHit() and anyHit() of intersect.hpp, through the BVH if there is
+// one; a shadow ray toward `light` only tests its occluders otherwise
+int sceneClosestHit(const Scene& sc, const vec3& o, const vec3& dir, const SphereColumns& s, int skip,
+                    float& d, RayStats* stats);
+bool sceneAnyHit(const Scene& sc, const vec3& o, const vec3& dir, const SphereColumns& s, int skip,
+                 unsigned light, RayStats* stats);
+vec3 reflect(const vec3& a, const vec3& dir, vec3 n);
+
+// the shading of a hit, in steps, shared by castRay() and the wavefront
+// (wavefront.hpp), which runs the shadow rays of every hit in between:
+// where ray (a, dir) hits sphere o at distance d, its normal there and the
+// reflected ray
+void hitPoint(const Scene& sc, const vec3& a, const vec3& dir, int o, float d, vec3& inter, vec3& n, vec3& s);
+// from light l to p
+vec3 lightDir(const Scene& sc, const vec3& p, unsigned l);
+// adds to color the diffuse and specular light l gives sphere i, if nothing shadows it
+void addLight(const Scene& sc, int i, const vec3& n, const vec3& s, unsigned l, const vec3& lDir, vec3& color);
+// the lights added, clamped, and the ambient light
+vec3 surfaceColor(const Scene& sc, int i, vec3 color);
+// color so far of a ray that reflected off `from` (-1 for a primary ray)
+// and got hitColor where it hit next
+vec3 addBounce(const Scene& sc, const vec3& color, int from, const vec3& hitColor);
+// whether a ray that hit sphere o at bounce, having gone attenuation, goes on
+bool reflects(const Scene& sc, int o, int bounce, float attenuation);
+
+vec3 compColor(const Scene& sc, const vec3& a, const vec3& dir, const vec3& inter,
+               const vec3& normal, const vec3& s, int i, RayStats* stats = NULL);
+vec3 castRay(const Scene& sc, const vec3& a_, const vec3& dir_, RayStats* stats = NULL);
+// same from its first hit, object o (-1 for none) at distance d
+vec3 castRay(const Scene& sc, const vec3& a_, const vec3& dir_, int o, float d, RayStats* stats = NULL);
+
+// ray of the pixel whose gl_FragCoord is (x + .5, y + .5), its first hit
+// (closestHit(), among the spheres of the pixel's screen tile if there are
+// lists) and its color
+void primaryRay(const Scene& sc, unsigned x, unsigned y, vec3& a, vec3& dir);
+int primaryHit(const Scene& sc, unsigned x, unsigned y, const vec3& a, const vec3& dir, float& d,
+               RayStats* stats = NULL);
+vec3 shadePixel(const Scene& sc, unsigned x, unsigned y, RayStats* stats = NULL);
+
+/*
+  Pixels are walked, within a tile and tile after tile, along a curve:
+  rows, or a Morton (Z) or Hilbert curve whose consecutive points stay
+  close in both directions. Through a BVH, the primary rays of `packet`
+  consecutive pixels look for their first hit together, loading each node
+  and sphere once for all of them; the more compact the packet on screen,
+  the fewer it has to load. Bounces and shadows go one ray at a time, and
+  so does everything without a BVH. The pixels are the same whatever the
+  walk.
+*/
+
+enum PixelOrder
+{
+    ORDER_ROWS,
+    ORDER_MORTON,
+    ORDER_HILBERT,
+    ORDERS
+};
+
+const char* pixelOrderName(PixelOrder order);
+// the order called name, false if there is none
+bool pixelOrderFromName(const char* name, PixelOrder& order);
+// point i of the curve over a side x side square, side a power of 2
+void curvePoint(PixelOrder order, unsigned side, unsigned i, unsigned& x, unsigned& y);
+
+struct TileWalk
+{
+    PixelOrder order;
+    unsigned packet;    // 1 for one ray at a time, up to Bvh::MAX_PACKET
+    bool wavefront;     // stage after stage for the whole tile (wavefront.hpp)
+
+    TileWalk() : order(ORDER_HILBERT), packet(16), wavefront(false) {}
+};
+
+// c as GL stores it in RGBA8
+void setPixel(Framebuffer& fb, unsigned x, unsigned y, const vec3& c);
+
+// shade pixels [x0, x1) x [y0, y1) of fb, the fetches of all rays counted
+// in stats and those of the primary rays in primary as well
+void renderTile(const Scene& sc, Framebuffer& fb, unsigned x0, unsigned y0, unsigned x1, unsigned y1,
+                const TileWalk& walk = TileWalk(), RayStats* stats = NULL, RayStats* primary = NULL);
+
+// render sc into fb (resized to sc.resolution) with `threads` workers started
+// for this frame only, 0 meaning one per hardware thread; a TileRenderer
+// keeps them (tiles.hpp)
+void renderFrame(const Scene& sc, Framebuffer& fb, unsigned threads = 0);
+
+#endif
@@ -0,0 +1,119 @@
+#include "resolution.hpp"
+#include <algorithm>
+#include <cmath>
+
+// weight of the last measure in the average
+#define SMOOTHING       .2
+// measures averaged before deciding anything
+#define SAMPLES         8
+// most the scale grows at once
+#define MAX_GROWTH      1.1f
+
+/***********************/
+/* RESOLUTION GOVERNOR */
+/***********************/
+
+ResolutionGovernor::ResolutionGovernor(unsigned width, unsigned height, double targetMs, float minScale)
+    : maxWidth_(width), maxHeight_(height), budget_(targetMs * RESOLUTION_HEADROOM), minScale_(minScale),
+      width_(width), height_(height), average_(0), samples_(0), settle_(0)
+{
+}
+
+bool ResolutionGovernor::update(double ms)
+{
+    if (settle_)
+    {
+        --settle_;
+        return false;
+    }
+
+    average_ = samples_ ? average_ + SMOOTHING * (ms - average_) : ms;
+    if (++samples_ < SAMPLES)
+        return false;
+
+    // within the budget but not far below it, nothing to do
+    if (average_ <= budget_ && average_ >= budget_ * .7)
+        return false;
+
+    // the time goes with the pixels, as the square of the scale
+    float s = scale() * sqrtf(budget_ / std::max(average_, 1e-3));
+    s = std::min(std::max(s, minScale_), std::min(scale() * MAX_GROWTH, 1.0f));
+
+    unsigned w = std::max(8u, unsigned(maxWidth_ * s / 8 + .5f) * 8);
+    w = std::min(w, maxWidth_);
+    if (w == width_)
+        return false;
+
+    width_ = w;
+    height_ = std::min(maxHeight_, unsigned(float(maxHeight_) * w / maxWidth_ + .5f));
+    samples_ = 0;
+    settle_ = GpuTimer::QUERIES;
+    return true;
+}
+
+/*****************/
+/* SCALED TARGET */
+/*****************/
+
+ScaledTarget::ScaledTarget()
+    : maxWidth_(0), maxHeight_(0), width_(0), height_(0), texture_(0), fbo_(0), unit_(0), target_(0),
+      upscale_(0), sceneSizeLoc_(-1), scaleLoc_(-1)
+{
+}
+
+void ScaledTarget::init(unsigned width, unsigned height, GLuint upscale, GLuint unit)
+{
+    maxWidth_ = width_ = width;
+    maxHeight_ = height_ = height;
+    unit_ = unit;
+
+    // allocated once at the largest size, a change of size costs nothing
+    glActiveTexture(GL_TEXTURE0 + unit);
+    glGenTextures(1, &texture_);
+    glBindTexture(GL_TEXTURE_2D, texture_);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glActiveTexture(GL_TEXTURE0);
+
+    GLint draw;
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &draw);
+    glGenFramebuffers(1, &fbo_);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, fbo_);
+    glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture_, 0);
+    glDrawBuffer(GL_COLOR_ATTACHMENT0);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, draw);
+
+    GLint current;
+    glGetIntegerv(GL_CURRENT_PROGRAM, &current);
+    upscale_ = upscale;
+    glUseProgram(upscale);
+    glUniform1i(glGetUniformLocation(upscale, "scene"), unit);
+    sceneSizeLoc_ = glGetUniformLocation(upscale, "sceneSize");
+    scaleLoc_ = glGetUniformLocation(upscale, "scale");
+    glUseProgram(current);
+}
+
+void ScaledTarget::begin(unsigned width, unsigned height)
+{
+    width_ = width;
+    height_ = height;
+
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &target_);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, fbo_);
+    glViewport(0, 0, width, height);
+}
+
+void ScaledTarget::end(ScreenTriangle& triangle)
+{
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, target_);
+    glViewport(0, 0, maxWidth_, maxHeight_);
+
+    GLint current;
+    glGetIntegerv(GL_CURRENT_PROGRAM, &current);
+    glUseProgram(upscale_);
+    glUniform2i(sceneSizeLoc_, width_, height_);
+    glUniform2f(scaleLoc_, float(width_) / maxWidth_, float(height_) / maxHeight_);
+    triangle.draw();
+    glUseProgram(current);
+}
@@ -0,0 +1,84 @@
+#ifndef RESOLUTION_HPP
+#define RESOLUTION_HPP
+
+#include "gl.hpp"
+
+/*
+  Dynamic resolution.
+
+  What fragment.glsl costs grows with the pixels it shades, and reflective
+  scenes cost several times the others. The scene can be drawn into a
+  ScaledTarget, of at most the window's size, which upscale.glsl then
+  stretches over the window. The ResolutionGovernor picks its size from the
+  GPU time of the last frames, to keep them within the frame budget.
+
+  Sizes keep the window's aspect ratio, widths being multiples of 8. A
+  measure only counts once the frames drawn before the last change are out
+  of the timer queries, and the scale goes up by small steps, so that it
+  does not oscillate between two sizes.
+*/
+
+// smallest scale of each side
+#define RESOLUTION_MIN_SCALE    .5f
+// part of the frame time the scene may take on the GPU
+#define RESOLUTION_HEADROOM     .8
+
+class ResolutionGovernor
+{
+public:
+    // frames of at most width x height, targetMs apart
+    ResolutionGovernor(unsigned width, unsigned height, double targetMs,
+                       float minScale = RESOLUTION_MIN_SCALE);
+
+    // GPU time of a frame drawn at the current size; true if it changed
+    bool update(double ms);
+
+    unsigned width() const { return width_; }
+    unsigned height() const { return height_; }
+    float scale() const { return float(width_) / maxWidth_; }
+
+private:
+    unsigned maxWidth_;
+    unsigned maxHeight_;
+    double budget_;     // ms
+    float minScale_;
+
+    unsigned width_;
+    unsigned height_;
+    double average_;    // ms, since the last change
+    unsigned samples_;
+    unsigned settle_;   // measures left that predate the last change
+};
+
+// a color texture the scene is drawn into, then stretched over the window
+class ScaledTarget
+{
+public:
+    ScaledTarget();
+
+    // texture of width x height (the window), upscale being the program
+    // built from upscale.glsl; unit is the texture unit it reads from
+    void init(unsigned width, unsigned height, GLuint upscale, GLuint unit);
+
+    // draws go to the bottom left width x height pixels of the texture
+    void begin(unsigned width, unsigned height);
+    // back to the framebuffer bound at begin(), covered with the texture
+    void end(ScreenTriangle& triangle);
+
+private:
+    unsigned maxWidth_;
+    unsigned maxHeight_;
+    unsigned width_;
+    unsigned height_;
+
+    GLuint texture_;
+    GLuint fbo_;
+    GLuint unit_;
+    GLint target_;      // framebuffer to go back to
+
+    GLuint upscale_;
+    GLint sceneSizeLoc_;
+    GLint scaleLoc_;
+};
+
+#endif
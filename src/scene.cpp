@@ -0,0 +1,171 @@
+#include "scene.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+/****************/
+/* COLUMN BLOCK */
+/****************/
+
+ColumnBlock::ColumnBlock(unsigned columns)
+    : columns_(columns), size_(0), capacity_(0), data_(NULL), dirty_(columns), moved_(false)
+{
+    clean();
+}
+
+ColumnBlock::~ColumnBlock()
+{
+    free(data_);
+}
+
+void ColumnBlock::resize(unsigned n)
+{
+    if (n > capacity_)
+    {
+        unsigned capacity = std::max(capacity_ * 2, unsigned(ALIGN));
+        while (capacity < n)
+            capacity *= 2;
+
+        void* p = NULL;
+        if (posix_memalign(&p, ALIGN * sizeof(float), columns_ * capacity * sizeof(float)))
+            throw std::bad_alloc();
+        float* data = (float*)p;
+        memset(data, 0, columns_ * capacity * sizeof(float));
+
+        for (unsigned c = 0; c < columns_ && data_; ++c)
+            memcpy(data + c * capacity, data_ + c * capacity_, size_ * sizeof(float));
+
+        free(data_);
+        data_ = data;
+        capacity_ = capacity;
+        moved_ = true;
+    }
+    else if (n > size_)
+    {
+        for (unsigned c = 0; c < columns_; ++c)
+            memset(column(c) + size_, 0, (n - size_) * sizeof(float));
+    }
+
+    if (n > size_)
+        for (unsigned c = 0; c < columns_; ++c)
+            touch(c, size_, n);
+
+    size_ = n;
+}
+
+void ColumnBlock::Range::merge(const Range& r)
+{
+    if (r.empty())
+        return;
+    if (empty())
+        *this = r;
+    else
+    {
+        begin = std::min(begin, r.begin);
+        end = std::max(end, r.end);
+    }
+}
+
+void ColumnBlock::touch(unsigned c, unsigned begin, unsigned end)
+{
+    dirty_[c].merge(Range{begin, end});
+}
+
+void ColumnBlock::touchAll()
+{
+    for (unsigned c = 0; c < columns_; ++c)
+        touch(c, 0, size_);
+}
+
+ColumnBlock::Range ColumnBlock::dirty(unsigned c) const
+{
+    Range r = dirty_[c];
+    r.end = std::min(r.end, size_);
+    return r;
+}
+
+void ColumnBlock::clean()
+{
+    for (unsigned c = 0; c < columns_; ++c)
+        dirty_[c] = Range{0, 0};
+    moved_ = false;
+}
+
+/***************/
+/* SCENE STORE */
+/***************/
+
+SceneStore::SceneStore()
+    : spheres_(FIELDS), lights_(LIGHT_FIELDS)
+{
+}
+
+void SceneStore::setSphere(unsigned i, const vec4& sphere, const vec3& color, const vec3& attr)
+{
+    setSphere(i, sphere);
+    setColor(i, color);
+    setAttr(i, attr);
+}
+
+void SceneStore::setSphere(unsigned i, const vec4& sphere)
+{
+    set(spheres_, X, i, sphere.x);
+    set(spheres_, Y, i, sphere.y);
+    set(spheres_, Z, i, sphere.z);
+    set(spheres_, R, i, sphere.w);
+}
+
+void SceneStore::setColor(unsigned i, const vec3& color)
+{
+    set(spheres_, RED, i, color.x);
+    set(spheres_, GREEN, i, color.y);
+    set(spheres_, BLUE, i, color.z);
+}
+
+void SceneStore::setAttr(unsigned i, const vec3& attr)
+{
+    set(spheres_, DIFFUSION, i, attr.x);
+    set(spheres_, REFLECTION, i, attr.y);
+    set(spheres_, SHININESS, i, attr.z);
+}
+
+vec4 SceneStore::sphere(unsigned i) const
+{
+    return vec4{column(X)[i], column(Y)[i], column(Z)[i], column(R)[i]};
+}
+
+vec3 SceneStore::color(unsigned i) const
+{
+    return vec3{column(RED)[i], column(GREEN)[i], column(BLUE)[i]};
+}
+
+vec3 SceneStore::attr(unsigned i) const
+{
+    return vec3{column(DIFFUSION)[i], column(REFLECTION)[i], column(SHININESS)[i]};
+}
+
+SphereColumns SceneStore::sphereColumns() const
+{
+    SphereColumns s = {column(X), column(Y), column(Z), column(R), int(size())};
+    return s;
+}
+
+void SceneStore::setLight(unsigned i, const vec4& light)
+{
+    setLightPosition(i, vec3{light.x, light.y, light.z});
+    set(lights_, LIGHT_INTENSITY, i, light.w);
+}
+
+void SceneStore::setLightPosition(unsigned i, const vec3& position)
+{
+    set(lights_, LIGHT_X, i, position.x);
+    set(lights_, LIGHT_Y, i, position.y);
+    set(lights_, LIGHT_Z, i, position.z);
+}
+
+vec4 SceneStore::light(unsigned i) const
+{
+    return vec4{lightColumn(LIGHT_X)[i], lightColumn(LIGHT_Y)[i],
+                lightColumn(LIGHT_Z)[i], lightColumn(LIGHT_INTENSITY)[i]};
+}
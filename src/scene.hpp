@@ -0,0 +1,173 @@
+#ifndef SCENE_HPP
+#define SCENE_HPP
+
+#include <vector>
+#include "vec.hpp"
+#include "intersect.hpp"
+
+/*
+  Scene data as structure of arrays.
+
+  Each field of the spheres (and of the lights) is a column of floats; all
+  the columns of a table live back to back in one 64-byte aligned block,
+  column c starting at c * capacity(). The block can be handed as is to the
+  SIMD kernels (sphereColumns()) or to GL (data(), bytes()), and animating
+  one field of every sphere walks contiguous memory.
+
+  Writes are tracked as one dirty range of rows per column, so that GL
+  uploads can be limited to what changed since the last clean().
+*/
+
+// `columns` float columns in one aligned block, growing on demand
+class ColumnBlock
+{
+public:
+    // columns start on this boundary, in floats (64 bytes)
+    static const unsigned ALIGN = 16;
+
+    explicit ColumnBlock(unsigned columns);
+    ~ColumnBlock();
+    ColumnBlock(const ColumnBlock&) = delete;
+    ColumnBlock& operator=(const ColumnBlock&) = delete;
+
+    unsigned size() const { return size_; }
+    unsigned capacity() const { return capacity_; }
+    unsigned columns() const { return columns_; }
+
+    // new rows are zeroed; growing moves the block (pointers are invalidated)
+    void resize(unsigned n);
+
+    // writing through column() is not tracked, see touch()
+    float* column(unsigned c) { return data_ + c * capacity_; }
+    const float* column(unsigned c) const { return data_ + c * capacity_; }
+
+    const float* data() const { return data_; }
+    unsigned bytes() const { return columns_ * capacity_ * sizeof(float); }
+
+    /****************/
+    /* DIRTY RANGES */
+    /****************/
+
+    // rows [begin, end), empty when begin >= end
+    struct Range
+    {
+        unsigned begin;
+        unsigned end;
+
+        bool empty() const { return begin >= end; }
+        void merge(const Range& r);
+    };
+
+    // mark rows as written
+    void touch(unsigned c, unsigned i) { touch(c, i, i + 1); }
+    void touch(unsigned c, unsigned begin, unsigned end);
+    void touchAll();
+
+    // rows of column c written since the last clean(), within size()
+    Range dirty(unsigned c) const;
+    // whether the block moved (capacity changed) since the last clean()
+    bool moved() const { return moved_; }
+    void clean();
+
+private:
+    unsigned columns_;
+    unsigned size_;
+    unsigned capacity_;
+    float* data_;
+
+    std::vector<Range> dirty_;
+    bool moved_;
+};
+
+class SceneStore
+{
+public:
+    // sphere columns
+    enum Field
+    {
+        X, Y, Z, R,                        // position and radius
+        RED, GREEN, BLUE,                  // color
+        DIFFUSION, REFLECTION, SHININESS,  // attributes (phong)
+        FIELDS
+    };
+
+    // light columns
+    enum LightField
+    {
+        LIGHT_X, LIGHT_Y, LIGHT_Z,         // position
+        LIGHT_INTENSITY,
+        LIGHT_FIELDS
+    };
+
+    SceneStore();
+
+    /***********/
+    /* SPHERES */
+    /***********/
+
+    unsigned size() const { return spheres_.size(); }
+    void resize(unsigned n) { spheres_.resize(n); }
+
+    // the whole column is marked dirty
+    float* column(Field f) { spheres_.touch(f, 0, size()); return spheres_.column(f); }
+    const float* column(Field f) const { return spheres_.column(f); }
+
+    float& x(unsigned i) { spheres_.touch(X, i); return spheres_.column(X)[i]; }
+    float& y(unsigned i) { spheres_.touch(Y, i); return spheres_.column(Y)[i]; }
+    float& z(unsigned i) { spheres_.touch(Z, i); return spheres_.column(Z)[i]; }
+
+    void setSphere(unsigned i, const vec4& sphere, const vec3& color, const vec3& attr);
+    void setSphere(unsigned i, const vec4& sphere);
+    void setColor(unsigned i, const vec3& color);
+    void setAttr(unsigned i, const vec3& attr);
+
+    vec4 sphere(unsigned i) const;
+    vec3 color(unsigned i) const;
+    vec3 attr(unsigned i) const;
+
+    // view for the SIMD kernels
+    SphereColumns sphereColumns() const;
+
+    // view for GL: FIELDS columns of capacity() floats
+    const float* data() const { return spheres_.data(); }
+    unsigned bytes() const { return spheres_.bytes(); }
+    unsigned capacity() const { return spheres_.capacity(); }
+
+    /**********/
+    /* LIGHTS */
+    /**********/
+
+    unsigned lightsSize() const { return lights_.size(); }
+    void resizeLights(unsigned n) { lights_.resize(n); }
+
+    // the whole column is marked dirty
+    float* lightColumn(LightField f) { lights_.touch(f, 0, lightsSize()); return lights_.column(f); }
+    const float* lightColumn(LightField f) const { return lights_.column(f); }
+
+    void setLight(unsigned i, const vec4& light);
+    void setLightPosition(unsigned i, const vec3& position);
+    vec4 light(unsigned i) const;
+
+    // view for GL: LIGHT_FIELDS columns of lightsCapacity() floats
+    const float* lightData() const { return lights_.data(); }
+    unsigned lightBytes() const { return lights_.bytes(); }
+    unsigned lightsCapacity() const { return lights_.capacity(); }
+
+    // the blocks themselves, for their dirty ranges
+    ColumnBlock& sphereBlock() { return spheres_; }
+    const ColumnBlock& sphereBlock() const { return spheres_; }
+    ColumnBlock& lightBlock() { return lights_; }
+    const ColumnBlock& lightBlock() const { return lights_; }
+
+private:
+    void set(ColumnBlock& block, unsigned c, unsigned i, float value)
+    {
+        block.column(c)[i] = value;
+        block.touch(c, i);
+    }
+
+    ColumnBlock spheres_;
+    ColumnBlock lights_;
+};
+
+#endif
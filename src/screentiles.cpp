@@ -0,0 +1,151 @@
+#include "screentiles.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+static double now()
+{
+    using namespace std::chrono;
+    return duration<double>(steady_clock::now().time_since_epoch()).count();
+}
+
+// range [lo, hi] of x / z over the disk of center (x, z) and radius r < z,
+// the slopes of its tangents through 0
+static void tangents(double x, double z, double r, double& lo, double& hi)
+{
+    double s = r * sqrt(x * x + z * z - r * r);
+    double den = z * z - r * r;
+    lo = (x * z - s) / den;
+    hi = (x * z + s) / den;
+}
+
+// tiles [first, last + 1) covering pixels [lo, hi] of a row of `size`
+static bool tileRange(double lo, double hi, unsigned size, unsigned& first, unsigned& last)
+{
+    lo = floor(lo - SCREEN_TILE_MARGIN);
+    hi = ceil(hi + SCREEN_TILE_MARGIN);
+    if (hi < 0 || lo > size - 1.0)
+        return false;
+    first = unsigned(std::max(lo, 0.0)) / SCREEN_TILE;
+    last = unsigned(std::min(hi, size - 1.0)) / SCREEN_TILE + 1;
+    return true;
+}
+
+ScreenTiles::ScreenTiles() : tilesX_(0), tilesY_(0), stats_()
+{
+}
+
+void ScreenTiles::build(const Scene& view)
+{
+    double start = now();
+    const SceneStore& st = *view.store;
+    unsigned n = st.size();
+    unsigned width = view.resolution.x;
+    unsigned height = view.resolution.y;
+    tilesX_ = (width + SCREEN_TILE - 1) / SCREEN_TILE;
+    tilesY_ = (height + SCREEN_TILE - 1) / SCREEN_TILE;
+    unsigned tiles = tilesX_ * tilesY_;
+
+    // the eye, and pixels per unit of x / z and y / z
+    double nx = view.normal.x, ny = view.normal.y, nz = view.normal.z;
+    double ex = view.origin.x - view.focal * nx;
+    double ey = view.origin.y - view.focal * ny;
+    double ez = view.origin.z - view.focal * nz;
+    double su = sqrt(dot(view.u, view.u)), sv = sqrt(dot(view.v, view.v));
+    double ux = view.u.x / su, uy = view.u.y / su, uz = view.u.z / su;
+    double vx = view.v.x / sv, vy = view.v.y / sv, vz = view.v.z / sv;
+    double scaleX = view.focal / su, scaleY = view.focal / sv;
+
+    bounds_.resize(n);
+    offsets_.assign(tiles + 1, 0);
+    for (unsigned i = 0; i < n; ++i)
+    {
+        Bounds& b = bounds_[i];
+        b.x0 = b.y0 = b.x1 = b.y1 = 0;
+
+        vec4 sp = st.sphere(i);
+        double qx = sp.x - ex, qy = sp.y - ey, qz = sp.z - ez;
+        double z = qx * nx + qy * ny + qz * nz;
+        // floats are rounded: a little more room in front and around
+        double slack = 1e-3 * (sqrt(qx * qx + qy * qy + qz * qz) + sp.w);
+        double r = sp.w + slack;
+
+        if (z + r < view.focal)
+            continue;
+        if (z - r <= 0)
+        {
+            b.x1 = tilesX_;
+            b.y1 = tilesY_;
+        }
+        else
+        {
+            // gl_FragCoord.x = x + .5 is x / z * scaleX + width / 2
+            double lo, hi;
+            tangents(qx * ux + qy * uy + qz * uz, z, r, lo, hi);
+            bool inX = tileRange(lo * scaleX + width / 2.0 - .5, hi * scaleX + width / 2.0 - .5, width, b.x0, b.x1);
+            tangents(qx * vx + qy * vy + qz * vz, z, r, lo, hi);
+            bool inY = tileRange(lo * scaleY + height / 2.0 - .5, hi * scaleY + height / 2.0 - .5, height, b.y0, b.y1);
+            if (!inX || !inY)
+            {
+                b.x0 = b.y0 = b.x1 = b.y1 = 0;
+                continue;
+            }
+        }
+
+        for (unsigned ty = b.y0; ty < b.y1; ++ty)
+            for (unsigned tx = b.x0; tx < b.x1; ++tx)
+                offsets_[ty * tilesX_ + tx + 1] += 1;
+    }
+
+    for (unsigned t = 0; t < tiles; ++t)
+        offsets_[t + 1] += offsets_[t];
+    unsigned total = offsets_[tiles];
+    indices_.resize(total);
+    x_.resize(total);
+    y_.resize(total);
+    z_.resize(total);
+    r_.resize(total);
+
+    // spheres in order, each one appended to its tiles
+    std::vector<int> next(offsets_.begin(), offsets_.end() - 1);
+    for (unsigned i = 0; i < n; ++i)
+    {
+        const Bounds& b = bounds_[i];
+        vec4 sp = st.sphere(i);
+        for (unsigned ty = b.y0; ty < b.y1; ++ty)
+            for (unsigned tx = b.x0; tx < b.x1; ++tx)
+            {
+                int k = next[ty * tilesX_ + tx]++;
+                indices_[k] = i;
+                x_[k] = sp.x;
+                y_[k] = sp.y;
+                z_[k] = sp.z;
+                r_[k] = sp.w;
+            }
+    }
+
+    stats_.builds += 1;
+    stats_.time += now() - start;
+    stats_.candidates += total;
+    stats_.tiles += tiles;
+    stats_.spheres += (unsigned long long)tiles * n;
+}
+
+void ScreenTiles::clear()
+{
+    tilesX_ = tilesY_ = 0;
+    offsets_.clear();
+    indices_.clear();
+    x_.clear();
+    y_.clear();
+    z_.clear();
+    r_.clear();
+}
+
+SphereColumns ScreenTiles::columns(unsigned t) const
+{
+    int first = offsets_[t];
+    SphereColumns c = {x_.data() + first, y_.data() + first, z_.data() + first, r_.data() + first,
+                       offsets_[t + 1] - first};
+    return c;
+}
@@ -0,0 +1,81 @@
+#ifndef SCREENTILES_HPP
+#define SCREENTILES_HPP
+
+#include <vector>
+#include "intersect.hpp"
+#include "raytracer.hpp"
+
+/*
+  Per tile of the screen, the spheres a primary ray of its pixels can hit.
+
+  A primary ray starts on the image plane and goes away from the eye (the
+  origin, focal behind it): what it hits is seen from the eye through its
+  pixel. Each sphere is projected from the eye, its bounds on the screen
+  being the tangents of its silhouette, widened by SCREEN_TILE_MARGIN
+  pixels; it goes to the list of every tile they cover, in index order so
+  that equal distances still pick the lowest index. A sphere that may reach
+  the plane of the eye covers the whole screen, one left entirely before
+  the image plane none of it.
+
+  Lists are built once per frame for the camera and resolution the rays are
+  shot with, in O(spheres + candidates); they are used without a BVH, which
+  already leaves out what is far from each ray.
+*/
+
+// pixels per side of a tile, and how far bounds are widened in pixels
+#define SCREEN_TILE         16
+#define SCREEN_TILE_MARGIN  2.0
+
+// what the builds cost and culled
+struct ScreenTileStats
+{
+    unsigned builds;
+    double time;                    // s, all builds
+    unsigned long long candidates;  // kept, all tiles of all builds
+    unsigned long long tiles;       // all builds
+    unsigned long long spheres;     // tiles x spheres, all builds
+};
+
+class ScreenTiles
+{
+public:
+    ScreenTiles();
+
+    // for the camera and resolution of view, and the spheres of view.store
+    void build(const Scene& view);
+    void clear();
+
+    bool empty() const { return offsets_.empty(); }
+    unsigned tilesX() const { return tilesX_; }
+    unsigned tilesY() const { return tilesY_; }
+    // tile of the pixel whose gl_FragCoord is (x + .5, y + .5)
+    unsigned tile(unsigned x, unsigned y) const { return y / SCREEN_TILE * tilesX_ + x / SCREEN_TILE; }
+
+    // candidates of tile t, for closestHit(), and the index of the k-th one
+    SphereColumns columns(unsigned t) const;
+    int sphere(unsigned t, int k) const { return indices_[offsets_[t] + k]; }
+
+    // tile t's candidates are indices()[offsets()[t], offsets()[t + 1])
+    const std::vector<int>& offsets() const { return offsets_; }
+    const std::vector<int>& indices() const { return indices_; }
+
+    const ScreenTileStats& stats() const { return stats_; }
+
+private:
+    // tiles [x0, x1) x [y0, y1) covered by each sphere, empty for none
+    struct Bounds
+    {
+        unsigned x0, y0, x1, y1;
+    };
+
+    unsigned tilesX_;
+    unsigned tilesY_;
+    std::vector<Bounds> bounds_;
+    std::vector<int> offsets_;
+    std::vector<int> indices_;
+    std::vector<float> x_, y_, z_, r_;  // the candidates, tile after tile
+
+    ScreenTileStats stats_;
+};
+
+#endif
@@ -0,0 +1,306 @@
+#include "shaders.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <vector>
+#include <sys/stat.h>
+
+#define LOG_MAX_LEN     1023
+
+static double now()
+{
+    using namespace std::chrono;
+    return duration<double>(steady_clock::now().time_since_epoch()).count();
+}
+
+static bool sourceFromFile(const char* filename, std::string& src)
+{
+    std::ifstream file(filename, std::ios::in | std::ios::binary);
+    std::stringstream s;
+    s << file.rdbuf();
+    src = s.str();
+    return file.good();
+}
+
+/***********/
+/* VARIANT */
+/***********/
+
+std::string ShaderVariant::defines() const
+{
+    std::ostringstream s;
+    if (spheres >= 0)
+        s << "#define OBJ_NB " << spheres << "\n";
+    if (lights >= 0)
+        s << "#define LIGHT_NB " << lights << "\n";
+    if (bounces >= 0)
+        s << "#define MAX_BOUNCES " << bounces << "\n";
+    return s.str();
+}
+
+std::string ShaderVariant::name() const
+{
+    if (spheres < 0 && lights < 0 && bounces < 0)
+        return "generic";
+
+    std::ostringstream s;
+    s << (spheres < 0 ? std::string("*") : std::to_string(spheres)) << " spheres, "
+      << (lights < 0 ? std::string("*") : std::to_string(lights)) << " lights, "
+      << (bounces < 0 ? std::string("*") : std::to_string(bounces)) << " bounces";
+    return s.str();
+}
+
+/****************/
+/* SHADER CACHE */
+/****************/
+
+ShaderCache::ShaderCache()
+    : current_(NULL), submitStart_(0)
+{
+}
+
+ShaderCache::~ShaderCache()
+{
+    // the context may be gone already, GL objects are left to it
+}
+
+bool ShaderCache::init(const char* vertexFile, const char* fragmentFile, const char* cacheDir)
+{
+    if (!sourceFromFile(vertexFile, vertex_) || !sourceFromFile(fragmentFile, fragment_))
+    {
+        std::cout << "cannot read " << vertexFile << " or " << fragmentFile << "\n";
+        return false;
+    }
+
+    GLint formats = 0;
+    if (cacheDir && (hasGlVersion(4, 1) || hasGlExtension("GL_ARB_get_program_binary")))
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+    if (formats > 0)
+    {
+        mkdir(cacheDir, 0755);
+        cacheDir_ = cacheDir;
+    }
+    else if (cacheDir)
+        std::cout << "no program binaries, the shaders are compiled at every launch\n";
+    return true;
+}
+
+// the defines go right after the #version line
+static std::string withDefines(const std::string& src, const std::string& defines)
+{
+    if (defines.empty())
+        return src;
+    size_t line = src.compare(0, 8, "#version") ? 0 : src.find('\n') + 1;
+    return src.substr(0, line) + defines + src.substr(line);
+}
+
+static GLuint compileShader(GLenum type, const std::string& src, const char* what)
+{
+    int status, len;
+    char log[LOG_MAX_LEN + 1];
+    const char* s = src.c_str();
+
+    GLuint shader = glCreateShader(type);
+    glShaderSource(shader, 1, &s, NULL);
+    glCompileShader(shader);
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
+    std::cout << what << " shader compilation: " << status << "\n";
+    if (!status)
+    {
+        std::cout << "===============================\n";
+        glGetShaderInfoLog(shader, LOG_MAX_LEN, &len, log);
+        std::cout.write(log, len);
+        std::cout << "===============================\n";
+    }
+    return shader;
+}
+
+GLuint ShaderCache::compile(const std::string& fragment)
+{
+    GLuint v = compileShader(GL_VERTEX_SHADER, vertex_, "vertex");
+    GLuint f = compileShader(GL_FRAGMENT_SHADER, fragment, "fragment");
+
+    // creating and linking shader program
+    int status;
+    GLuint p = glCreateProgram();
+    glAttachShader(p, v);
+    glAttachShader(p, f);
+    if (!cacheDir_.empty())
+        glProgramParameteri(p, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    glLinkProgram(p);
+    glGetProgramiv(p, GL_LINK_STATUS, &status);
+    std::cout << "program linking: " << status << "\n";
+
+    // the program keeps them
+    glDeleteShader(v);
+    glDeleteShader(f);
+
+    if (!status)
+    {
+        glDeleteProgram(p);
+        return 0;
+    }
+    return p;
+}
+
+GLuint ShaderCache::program(const ShaderVariant& variant)
+{
+    std::string defines = variant.defines();
+    std::map<std::string, Program>::iterator it = programs_.find(defines);
+    if (it != programs_.end())
+        return it->second.id;
+
+    double t = now();
+    std::string fragment = withDefines(fragment_, defines);
+    std::string path = cacheDir_.empty() ? std::string() : binaryPath(fragment);
+
+    Program p;
+    p.id = path.empty() ? 0 : load(path);
+    p.cached = p.id != 0;
+    if (!p.cached)
+    {
+        p.id = compile(fragment);
+        if (p.id && !path.empty())
+            save(p.id, path);
+    }
+    p.name = variant.name();
+    p.compileTime = now() - t;
+    p.draws = 0;
+    p.gpuTime = 0;
+    p.submits = 0;
+    p.submitTime = 0;
+    std::cout << "program " << p.name << ": " << p.compileTime * 1e3 << " ms to "
+              << (p.cached ? "load" : "compile") << "\n";
+
+    programs_[defines] = p;
+    return p.id;
+}
+
+/********************/
+/* PROGRAM BINARIES */
+/********************/
+
+// 64-bit FNV-1a
+static unsigned long long hash(const std::string& s, unsigned long long h = 14695981039346656037ULL)
+{
+    for (unsigned char c : s)
+        h = (h ^ c) * 1099511628211ULL;
+    return h;
+}
+
+std::string ShaderCache::binaryPath(const std::string& fragment) const
+{
+    // a driver update makes binaries stale, so does any change to the sources
+    std::string driver = std::string((const char*) glGetString(GL_VENDOR)) + "\n"
+        + (const char*) glGetString(GL_RENDERER) + "\n" + (const char*) glGetString(GL_VERSION) + "\n";
+    unsigned long long h = hash(fragment, hash(vertex_ + '\0', hash(driver)));
+
+    char name[32];
+    snprintf(name, sizeof(name), "/%016llx.bin", h);
+    return cacheDir_ + name;
+}
+
+// the binary format then the binary, 0 if missing or refused
+GLuint ShaderCache::load(const std::string& path)
+{
+    std::string data;
+    if (!sourceFromFile(path.c_str(), data) || data.size() <= sizeof(GLenum))
+        return 0;
+
+    GLenum format;
+    memcpy(&format, data.data(), sizeof(format));
+
+    GLint status;
+    GLuint p = glCreateProgram();
+    glProgramBinary(p, format, data.data() + sizeof(format), data.size() - sizeof(format));
+    glGetProgramiv(p, GL_LINK_STATUS, &status);
+    if (!status)
+    {
+        std::cout << path << ": binary refused, compiling again\n";
+        // an unknown format is also a GL_INVALID_ENUM, not worth reporting
+        while (glGetError() != GL_NO_ERROR)
+            ;
+        glDeleteProgram(p);
+        return 0;
+    }
+    return p;
+}
+
+void ShaderCache::save(GLuint program, const std::string& path)
+{
+    GLint length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0)
+        return;
+
+    GLenum format;
+    std::vector<char> binary(length);
+    glGetProgramBinary(program, length, &length, &format, binary.data());
+
+    // written aside then renamed, so that another launch never reads half a file
+    std::string tmp = path + ".tmp";
+    std::ofstream file(tmp.c_str(), std::ios::out | std::ios::binary);
+    file.write((const char*) &format, sizeof(format));
+    file.write(binary.data(), length);
+    file.close();
+    if (!file || rename(tmp.c_str(), path.c_str()))
+    {
+        std::cout << path << ": cannot write the program binary\n";
+        remove(tmp.c_str());
+    }
+}
+
+/**********/
+/* TIMING */
+/**********/
+
+ShaderCache::Program* ShaderCache::find(GLuint p)
+{
+    for (auto& it : programs_)
+        if (it.second.id == p)
+            return &it.second;
+    return NULL;
+}
+
+void ShaderCache::beginDraw(GLuint p)
+{
+    current_ = find(p);
+    submitStart_ = now();
+}
+
+void ShaderCache::endDraw()
+{
+    if (current_)
+    {
+        current_->submits += 1;
+        current_->submitTime += now() - submitStart_;
+    }
+}
+
+void ShaderCache::drawTime(GLuint p, double seconds)
+{
+    Program* program = find(p);
+    if (program)
+    {
+        program->draws += 1;
+        program->gpuTime += seconds;
+    }
+}
+
+void ShaderCache::report()
+{
+    for (auto& it : programs_)
+    {
+        const Program& p = it.second;
+        std::cout << "  " << p.name << ": " << (p.cached ? "loaded" : "compiled") << " in "
+                  << p.compileTime * 1e3 << " ms";
+        if (p.draws)
+            std::cout << ", " << p.gpuTime / p.draws * 1e3 << " ms per frame (" << p.draws << " frames)";
+        if (p.submits)
+            std::cout << ", " << p.submitTime / p.submits * 1e6 << " us to submit";
+        std::cout << "\n";
+    }
+}
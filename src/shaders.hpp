@@ -0,0 +1,96 @@
+#ifndef SHADERS_HPP
+#define SHADERS_HPP
+
+#include <map>
+#include <string>
+#include "gl.hpp"
+
+/*
+  The ray tracing program and its variants.
+
+  fragment.glsl loops over objNb spheres, lNb lights and bounces until the
+  attenuation limit, all of them uniforms. A variant is the same source with
+  some of them turned into constants by #defines inserted after #version
+  (OBJ_NB, LIGHT_NB, MAX_BOUNCES), so that the compiler can unroll and fold
+  those loops. Each variant is compiled on first use and kept; switching
+  scene shape is then a glUseProgram.
+
+  With GL 4.1 (or ARB_get_program_binary) and a cache directory, linked
+  programs are saved with glGetProgramBinary, under a hash of both sources
+  with the defines and of the GL vendor, renderer and version strings, and
+  loaded from there on the next launches; a binary the driver refuses is
+  compiled again and replaced.
+
+  Each program's draws can be timed (GPU times come from a GpuTimer), to
+  compare the variants with the generic program.
+*/
+
+// scene shape a program is compiled for, -1 leaving the uniform
+struct ShaderVariant
+{
+    int spheres;
+    int lights;
+    int bounces;
+
+    // the generic program
+    ShaderVariant() : spheres(-1), lights(-1), bounces(-1) {}
+
+    bool operator!=(const ShaderVariant& v) const
+    {
+        return spheres != v.spheres || lights != v.lights || bounces != v.bounces;
+    }
+
+    std::string defines() const;
+    std::string name() const;
+};
+
+class ShaderCache
+{
+public:
+    ShaderCache();
+    ~ShaderCache();
+
+    // reads the sources; false if one is missing. Program binaries are
+    // kept in cacheDir (created if needed), NULL for none
+    bool init(const char* vertexFile, const char* fragmentFile, const char* cacheDir = NULL);
+
+    // compiled on first use, 0 if it does not compile or link
+    GLuint program(const ShaderVariant& variant);
+
+    // what submitting the draws between begin and end costs on the CPU
+    void beginDraw(GLuint p);
+    void endDraw();
+    // GPU time of a frame drawn with program p
+    void drawTime(GLuint p, double seconds);
+    // average times and compile time of every program so far
+    void report();
+
+private:
+    struct Program
+    {
+        GLuint id;
+        std::string name;
+        double compileTime;     // s, or to load it
+        bool cached;            // loaded from its binary
+        unsigned draws;         // timed
+        double gpuTime;         // s, timed draws
+        unsigned submits;
+        double submitTime;      // s, on the CPU between begin and end
+    };
+
+    GLuint compile(const std::string& fragment);
+    std::string binaryPath(const std::string& fragment) const;
+    GLuint load(const std::string& path);
+    void save(GLuint program, const std::string& path);
+    Program* find(GLuint p);
+
+    std::string vertex_;
+    std::string fragment_;
+    std::map<std::string, Program> programs_;   // by defines
+    std::string cacheDir_;  // empty without binaries
+
+    Program* current_;      // between beginDraw and endDraw
+    double submitStart_;
+};
+
+#endif
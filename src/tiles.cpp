@@ -0,0 +1,260 @@
+#include "tiles.hpp"
+#include <algorithm>
+#include <chrono>
+#ifdef __linux__
+#include <pthread.h>
+#endif
+
+static double now()
+{
+    using namespace std::chrono;
+    return duration<double>(steady_clock::now().time_since_epoch()).count();
+}
+
+TileRenderer::TileRenderer(unsigned threads, bool pin)
+    : queues_(threads ? threads : std::max(std::thread::hardware_concurrency(), 1u)),
+      scene_(NULL), fb_(NULL), tileSize_(TILE_SIZE), tilesX_(0), tilesY_(0), orderOf_(ORDERS),
+      generation_(0), running_(0),
+      quit_(false), stats_(), frameBusy_(0), frameTiles_(0)
+{
+    for (Queue& q : queues_)
+    {
+        q.begin = q.end = 0;
+        q.stats = TileWorkerStats();
+    }
+    stats_.workers.resize(queues_.size());
+
+    unsigned cores = std::max(std::thread::hardware_concurrency(), 1u);
+    for (unsigned i = 1; i < queues_.size(); ++i)
+    {
+        pool_.push_back(std::thread(&TileRenderer::workerLoop, this, i));
+#ifdef __linux__
+        if (pin)
+        {
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            CPU_SET(i % cores, &set);
+            pthread_setaffinity_np(pool_.back().native_handle(), sizeof(set), &set);
+        }
+#else
+        (void) pin;
+        (void) cores;
+#endif
+    }
+}
+
+TileRenderer::~TileRenderer()
+{
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        quit_ = true;
+    }
+    changed_.notify_all();
+    for (std::thread& t : pool_)
+        t.join();
+}
+
+void TileRenderer::render(const Scene& sc, Framebuffer& fb)
+{
+    fb.resize(sc.resolution.x, sc.resolution.y);
+
+    // as many tiles as the size allows, at least TILES_PER_WORKER each
+    while (tileSize_ > TILE_MIN
+           && ((fb.width + tileSize_ - 1) / tileSize_) * ((fb.height + tileSize_ - 1) / tileSize_)
+              < TILES_PER_WORKER * queues_.size())
+        tileSize_ /= 2;
+
+    unsigned tilesX = (fb.width + tileSize_ - 1) / tileSize_;
+    unsigned tilesY = (fb.height + tileSize_ - 1) / tileSize_;
+    unsigned tilesNb = tilesX * tilesY;
+
+    // the curve over a power of 2 square, without the tiles out of the frame
+    if (tilesX != tilesX_ || tilesY != tilesY_ || walk_.order != orderOf_)
+    {
+        tilesX_ = tilesX;
+        tilesY_ = tilesY;
+        orderOf_ = walk_.order;
+        order_.clear();
+
+        unsigned side = 1;
+        while (side < tilesX || side < tilesY)
+            side *= 2;
+        for (unsigned i = 0; i < side * side; ++i)
+        {
+            unsigned x, y;
+            curvePoint(walk_.order, side, i, x, y);
+            if (x < tilesX && y < tilesY)
+                order_.push_back(y * tilesX + x);
+        }
+    }
+
+    // runs of consecutive tiles, one per worker
+    unsigned n = queues_.size();
+    for (unsigned i = 0; i < n; ++i)
+    {
+        queues_[i].begin = tilesNb * i / n;
+        queues_[i].end = tilesNb * (i + 1) / n;
+    }
+    scene_ = &sc;
+    fb_ = &fb;
+
+    double start = now();
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        ++generation_;
+        running_ = n;
+    }
+    changed_.notify_all();
+
+    work(0);
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    changed_.wait(lock, [this]() { return running_ == 0; });
+    double wall = now() - start;
+
+    for (unsigned i = 0; i < n; ++i)
+        queues_[i].stats.idle = wall - queues_[i].stats.busy;
+
+    stats_.frames += 1;
+    stats_.time += wall;
+    frameBusy_ = 0;
+    frameTiles_ = 0;
+    for (unsigned i = 0; i < n; ++i)
+    {
+        TileWorkerStats& s = stats_.workers[i];
+        const TileWorkerStats& f = queues_[i].stats;
+        s.busy += f.busy;
+        s.idle += f.idle;
+        s.tiles += f.tiles;
+        s.steals += f.steals;
+        s.rays.add(f.rays);
+        s.primary.add(f.primary);
+        s.stages.add(f.stages);
+        frameBusy_ += f.busy;
+        frameTiles_ += f.tiles;
+    }
+    adapt(wall);
+}
+
+void TileRenderer::adapt(double wall)
+{
+    unsigned larger = tileSize_ * 2;
+    unsigned largerNb = ((fb_->width + larger - 1) / larger) * ((fb_->height + larger - 1) / larger);
+
+    double idle = 1 - frameBusy_ / (wall * queues_.size());
+    if (frameTiles_ && frameBusy_ / frameTiles_ < MIN_TILE_US * 1e-6 && larger <= TILE_MAX
+        && largerNb >= TILES_PER_WORKER * queues_.size())
+        tileSize_ = larger;
+    else if (idle > MAX_IDLE && tileSize_ > TILE_MIN)
+        tileSize_ /= 2;
+}
+
+void TileRenderer::workerLoop(unsigned i)
+{
+    unsigned seen = 0;
+    for (;;)
+    {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            changed_.wait(lock, [&]() { return generation_ != seen || quit_; });
+            if (quit_)
+                return;
+            seen = generation_;
+        }
+        work(i);
+    }
+}
+
+void TileRenderer::work(unsigned i)
+{
+    Queue& q = queues_[i];
+    q.stats = TileWorkerStats();
+
+    unsigned tile;
+    while (pop(i, tile))
+    {
+        double t = now();
+        unsigned x = (order_[tile] % tilesX_) * tileSize_;
+        unsigned y = (order_[tile] / tilesX_) * tileSize_;
+        unsigned x1 = std::min(x + tileSize_, fb_->width);
+        unsigned y1 = std::min(y + tileSize_, fb_->height);
+        if (walk_.wavefront)
+            q.wavefront.renderTile(*scene_, *fb_, x, y, x1, y1, walk_, &q.stats.rays, &q.stats.primary,
+                                   &q.stats.stages);
+        else
+            renderTile(*scene_, *fb_, x, y, x1, y1, walk_, &q.stats.rays, &q.stats.primary);
+        q.stats.busy += now() - t;
+        q.stats.tiles += 1;
+    }
+
+    bool last;
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        last = --running_ == 0;
+    }
+    if (last)
+        changed_.notify_all();
+}
+
+// the next tile of worker i, stolen if its own queue is empty
+bool TileRenderer::pop(unsigned i, unsigned& tile)
+{
+    Queue& q = queues_[i];
+    {
+        std::unique_lock<std::mutex> lock(q.mutex);
+        if (q.begin < q.end)
+        {
+            tile = q.begin++;
+            return true;
+        }
+    }
+
+    for (;;)
+    {
+        // the longest queue, which may be shorter by the time it is locked again
+        unsigned victim = i, longest = 0;
+        for (unsigned k = 0; k < queues_.size(); ++k)
+        {
+            if (k == i)
+                continue;
+            std::unique_lock<std::mutex> lock(queues_[k].mutex);
+            if (queues_[k].end > queues_[k].begin && queues_[k].end - queues_[k].begin > longest)
+            {
+                victim = k;
+                longest = queues_[k].end - queues_[k].begin;
+            }
+        }
+        if (victim == i)
+            return false;
+
+        Queue& v = queues_[victim];
+        unsigned begin, end;
+        {
+            std::unique_lock<std::mutex> lock(v.mutex);
+            if (v.begin >= v.end)
+                continue;
+            // the back half, rounded up: a single tile left goes too
+            end = v.end;
+            begin = v.end - (v.end - v.begin + 1) / 2;
+            v.end = begin;
+        }
+
+        std::unique_lock<std::mutex> lock(q.mutex);
+        tile = begin;
+        q.begin = begin + 1;
+        q.end = end;
+        q.stats.steals += 1;
+        return true;
+    }
+}
+
+TileStats TileRenderer::takeStats()
+{
+    TileStats s = stats_;
+    s.tileSize = tileSize_;
+    stats_.frames = 0;
+    stats_.time = 0;
+    for (TileWorkerStats& w : stats_.workers)
+        w = TileWorkerStats();
+    return s;
+}
@@ -0,0 +1,124 @@
+#ifndef TILES_HPP
+#define TILES_HPP
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "raytracer.hpp"
+#include "wavefront.hpp"
+
+/*
+  The CPU renderer's threads, and how the frame is shared between them.
+
+  A pixel on a reflective sphere runs the whole castRay() bounce loop, one
+  on the background stops at the first miss: the cost of a tile is unknown
+  until it is rendered. Each worker starts the frame with its own run of
+  consecutive tiles (a deque: it takes from the front) and a worker with
+  none left steals the back half of the longest run still queued, so that
+  the workers keep busy until the last tiles and each one still mostly
+  walks neighbouring tiles.
+
+  The workers are kept from frame to frame, the calling thread being one
+  of them. The tile size adapts: it doubles while a tile takes less than
+  MIN_TILE_US (the locks cost more than the tile) and halves while the
+  workers spend more than MAX_IDLE of the frame waiting for the last
+  tiles, within [TILE_MIN, TILE_MAX] and with at least TILES_PER_WORKER
+  tiles per worker.
+
+  Tiles are numbered along the walk's curve (see TileWalk), so that a run
+  of them is a compact region of the screen rather than a band of rows.
+
+  With pinning (Linux), worker i (not the calling thread) stays on core
+  i % cores.
+*/
+
+#define TILE_MIN            8
+#define TILE_MAX            64
+#define TILES_PER_WORKER    8
+#define MIN_TILE_US         20.0
+#define MAX_IDLE            .05
+
+struct TileWorkerStats
+{
+    double busy;        // s rendering tiles
+    double idle;        // s of the frames spent waiting
+    unsigned tiles;
+    unsigned steals;
+    RayStats rays;      // all of them
+    RayStats primary;   // the first hits of the pixels
+    WavefrontStats stages;  // with walk.wavefront
+};
+
+struct TileStats
+{
+    unsigned frames;
+    double time;        // s, wall time of the frames
+    unsigned tileSize;  // now
+    std::vector<TileWorkerStats> workers;
+};
+
+class TileRenderer
+{
+public:
+    // `threads` workers, 0 for one per hardware thread
+    explicit TileRenderer(unsigned threads = 0, bool pin = false);
+    ~TileRenderer();
+    TileRenderer(const TileRenderer&) = delete;
+    TileRenderer& operator=(const TileRenderer&) = delete;
+
+    // render sc into fb (resized to sc.resolution)
+    void render(const Scene& sc, Framebuffer& fb);
+
+    // how tiles and their pixels are walked
+    void setWalk(const TileWalk& walk) { walk_ = walk; }
+    const TileWalk& walk() const { return walk_; }
+
+    unsigned threads() const { return queues_.size(); }
+    unsigned tileSize() const { return tileSize_; }
+    // since the last call
+    TileStats takeStats();
+
+private:
+    // tiles [begin, end) of the frame still to render by a worker
+    struct Queue
+    {
+        std::mutex mutex;
+        unsigned begin;
+        unsigned end;
+        TileWorkerStats stats;
+        Wavefront wavefront;
+        char pad[64];   // not on the cache line of the next worker's
+    };
+
+    void workerLoop(unsigned i);
+    void work(unsigned i);
+    bool pop(unsigned i, unsigned& tile);
+    void adapt(double wall);
+
+    std::vector<Queue> queues_;
+    std::vector<std::thread> pool_;
+
+    // the frame being rendered
+    const Scene* scene_;
+    Framebuffer* fb_;
+    TileWalk walk_;
+    unsigned tileSize_;
+    unsigned tilesX_;
+    unsigned tilesY_;
+    PixelOrder orderOf_;            // what order_ was made for
+    std::vector<unsigned> order_;   // tiles, row after row, along the curve
+
+    // workers wait for a new generation, the caller for all of them to be done
+    std::mutex mutex_;
+    std::condition_variable changed_;
+    unsigned generation_;
+    unsigned running_;
+    bool quit_;
+
+    TileStats stats_;
+    double frameBusy_;      // s, last frame, all workers
+    unsigned frameTiles_;
+};
+
+#endif
@@ -0,0 +1,474 @@
+#include "timeline.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+#define PI 3.14159265358979323846
+#define DEG2RAD(DEG) ((DEG) * (PI/180.0))
+
+// tempo of the demo's music, without a bpm line
+#define DEFAULT_BPM 129
+
+// last tic a segment may name, over a week of music at 100 bpm
+#define MAX_TIC     1000000
+
+/***********/
+/* ACTIONS */
+/***********/
+
+/*
+  The ring is every sphere but the first (the one in the middle), spread
+  evenly on a circle of the plane xz or xy, sphere i + 1 at i * 360 / n deg.
+*/
+enum Op
+{
+    BPM_,           // beats per minute, from the tic of its enter if in one
+    OFFSET,         // ms of music of the first beat (settings, not actions)
+    LIGHTS,         // n
+    LIGHT,          // i  x y z  intensity
+    AMBIENT,        // ambient light
+    CAMERA,         // x y z
+    TARGET,         // x y z
+    SPHERES,        // n
+    SPHERE,         // i  x y z radius  r g b  diffusion reflection shininess
+    RING,           // plane  radius  sphere radius
+    RING_COLOR,     // r g b
+    RING_ATTR,      // diffusion reflection shininess
+    SPIN,           // plane  radius  ms per degree: the ring turns with the music
+    RISE,           // speed: the ring moves up, by speed per second
+    PULSE,          // per beat: the ring goes from yellow to magenta and back
+    OPS
+};
+
+static const struct
+{
+    const char* name;
+    unsigned args;
+    bool plane;     // first argument is xz or xy
+    bool count;     // first argument is a count or an index, from 0
+} ops[OPS] = {
+    {"bpm", 1, false, false},
+    {"offset", 1, false, false},
+    {"lights", 1, false, true},
+    {"light", 5, false, true},
+    {"ambient", 1, false, false},
+    {"camera", 3, false, false},
+    {"target", 3, false, false},
+    {"spheres", 1, false, true},
+    {"sphere", 11, false, true},
+    {"ring", 3, true, false},
+    {"ring-color", 3, false, false},
+    {"ring-attr", 3, false, false},
+    {"spin", 3, true, false},
+    {"rise", 1, false, false},
+    {"pulse", 1, false, false},
+};
+
+// cosine and sine of angle, angle + step, angle + 2 step... (degrees),
+// two calls to the math library for the whole ring
+struct Rotation
+{
+    double c, s;
+    double dc, ds;
+
+    Rotation(double angle, double step)
+        : c(std::cos(DEG2RAD(angle))), s(std::sin(DEG2RAD(angle))),
+          dc(std::cos(DEG2RAD(step))), ds(std::sin(DEG2RAD(step)))
+    {
+    }
+
+    void next()
+    {
+        double c2 = c * dc - s * ds;
+        s = s * dc + c * ds;
+        c = c2;
+    }
+};
+
+/************/
+/* TIMELINE */
+/************/
+
+Timeline::Timeline()
+    : beats(DEFAULT_BPM), ambientLight(.5), updateCamera(false), updateScene(false),
+      updateLights(false), last_(0), applied_(-1)
+{
+}
+
+bool Timeline::load(const char* path)
+{
+    std::ifstream file(path);
+    if (!file)
+    {
+        std::cout << path << ": cannot read the timeline\n";
+        return false;
+    }
+    std::stringstream text;
+    text << file.rdbuf();
+    return parse(text.str(), path);
+}
+
+bool Timeline::parse(const std::string& text, const char* path)
+{
+    actions_.clear();
+    enters_.clear();
+    updates_.clear();
+    beats = BeatClock(DEFAULT_BPM);
+
+    std::vector<Segment>* segments = NULL;
+    std::istringstream lines(text);
+    std::string line;
+    for (unsigned n = 1; std::getline(lines, line); ++n)
+    {
+        line = line.substr(0, line.find('#'));
+        std::istringstream words(line);
+        std::string word;
+        if (!(words >> word))
+            continue;
+
+        // a new segment
+        if (word == "enter" || word == "until")
+        {
+            // signed, or -1 would read as a huge tic
+            long tic;
+            if (!(words >> tic) || tic < 1 || tic > MAX_TIC)
+            {
+                std::cout << path << ":" << n << ": " << word << " takes a tic, from 1 to " << MAX_TIC << "\n";
+                return false;
+            }
+            Segment s;
+            s.tic = tic;
+            s.first = actions_.size();
+            s.count = 0;
+            segments = word == "enter" ? &enters_ : &updates_;
+            segments->push_back(s);
+            continue;
+        }
+
+        Action a = Action();
+        a.op = 0;
+        while (a.op < OPS && word != ops[a.op].name)
+            ++a.op;
+        if (a.op == OPS)
+        {
+            std::cout << path << ":" << n << ": unknown action " << word << "\n";
+            return false;
+        }
+
+        unsigned i = 0;
+        if (ops[a.op].plane && words >> word)
+        {
+            if (word != "xz" && word != "xy")
+            {
+                std::cout << path << ":" << n << ": " << ops[a.op].name << " turns in xz or xy\n";
+                return false;
+            }
+            a.args[i++] = word == "xy";
+        }
+        while (i < ops[a.op].args && words >> a.args[i])
+            ++i;
+        if (i < ops[a.op].args || words >> word)
+        {
+            std::cout << path << ":" << n << ": " << ops[a.op].name << " takes " << ops[a.op].args
+                      << " arguments\n";
+            return false;
+        }
+        if (ops[a.op].count && a.args[0] < 0)
+        {
+            std::cout << path << ":" << n << ": " << ops[a.op].name << " takes "
+                      << (ops[a.op].args == 1 ? "a count" : "an index") << ", from 0\n";
+            return false;
+        }
+
+        if (a.op == BPM_ && !segments)
+            beats.setTempo(0, a.args[0]);
+        else if (a.op == BPM_ && segments == &enters_)
+            beats.setTempo(segments->back().tic - 1, a.args[0]);
+        else if (a.op == OFFSET && !segments)
+            beats.setOffset(a.args[0]);
+        else if (a.op == BPM_ || a.op == OFFSET)
+        {
+            std::cout << path << ":" << n << ": " << ops[a.op].name << " in an until\n";
+            return false;
+        }
+        else if (!segments)
+        {
+            std::cout << path << ":" << n << ": " << ops[a.op].name << " outside of a segment\n";
+            return false;
+        }
+        else
+        {
+            // segments are read in order, this one is the last
+            actions_.push_back(a);
+            ++segments->back().count;
+        }
+    }
+
+    auto byTic = [](const Segment& a, const Segment& b) { return a.tic < b.tic; };
+    std::stable_sort(enters_.begin(), enters_.end(), byTic);
+    std::stable_sort(updates_.begin(), updates_.end(), byTic);
+
+    last_ = 0;
+    if (!enters_.empty())
+        last_ = enters_.back().tic;
+    if (!updates_.empty())
+        last_ = std::max(last_, updates_.back().tic);
+
+    // the tics the scene jumps on: an enter starts, or an until ended
+    // before; the others keep the checkpoint of the one before
+    std::vector<unsigned> tics;
+    for (const Segment& s : enters_)
+        tics.push_back(s.tic);
+    for (const Segment& s : updates_)
+        if (s.tic < last_)
+            tics.push_back(s.tic + 1);
+    std::sort(tics.begin(), tics.end());
+    tics.erase(std::unique(tics.begin(), tics.end()), tics.end());
+
+    // play the timeline once, from the empty scene
+    SceneStore scene;
+    cameraOrigin = cameraTarget = vec3();
+    ambientLight = .5;
+    checkpoints_.clear();
+    save(0, scene);
+
+    unsigned e = 0;
+    for (unsigned tic : tics)
+    {
+        double time = ticTime(tic);
+        updateScene = updateCamera = updateLights = false;
+
+        // the until of the previous tic leaves the scene as it is at its end
+        unsigned u = updateAt(tic - 1);
+        if (u < updates_.size() && updates_[u].tic == tic - 1)
+            run(updates_[u], time, scene, checkpoints_.back());
+        for (; e < enters_.size() && enters_[e].tic == tic; ++e)
+            run(enters_[e], time, scene, checkpoints_.back());
+
+        save(tic, scene);
+    }
+
+    applied_ = -1;
+    restore(checkpoints_[0], scene);
+    updateScene = updateCamera = updateLights = false;
+    return true;
+}
+
+unsigned Timeline::ticAt(double T) const
+{
+    // tic n is beat n - 1, the margin keeps ticAt(ticTime(n)) on n
+    double beat = beats.beat(T) + 1e-9;
+    return beat < 0 ? 0 : unsigned(beat) + 1;
+}
+
+double Timeline::ticTime(unsigned tic) const
+{
+    return tic ? beats.time(tic - 1) : 0;
+}
+
+unsigned Timeline::checkpointAt(unsigned tic) const
+{
+    auto after = [](unsigned tic, const Checkpoint& c) { return tic < c.tic; };
+    return std::upper_bound(checkpoints_.begin(), checkpoints_.end(), tic, after) - checkpoints_.begin() - 1;
+}
+
+unsigned Timeline::updateAt(unsigned tic) const
+{
+    // the earliest one not over
+    auto before = [](const Segment& s, unsigned tic) { return s.tic < tic; };
+    return std::lower_bound(updates_.begin(), updates_.end(), tic, before) - updates_.begin();
+}
+
+void Timeline::save(unsigned tic, const SceneStore& scene)
+{
+    Checkpoint c;
+    c.tic = tic;
+    c.time = ticTime(tic);
+    for (unsigned f = 0; f < SceneStore::FIELDS; ++f)
+    {
+        const float* column = scene.column(SceneStore::Field(f));
+        c.spheres.insert(c.spheres.end(), column, column + scene.size());
+    }
+    for (unsigned f = 0; f < SceneStore::LIGHT_FIELDS; ++f)
+    {
+        const float* column = scene.lightColumn(SceneStore::LightField(f));
+        c.lights.insert(c.lights.end(), column, column + scene.lightsSize());
+    }
+    c.cameraOrigin = cameraOrigin;
+    c.cameraTarget = cameraTarget;
+    c.ambientLight = ambientLight;
+    checkpoints_.push_back(c);
+}
+
+void Timeline::restore(const Checkpoint& c, SceneStore& scene)
+{
+    unsigned n = c.spheres.size() / SceneStore::FIELDS;
+    scene.resize(n);
+    for (unsigned i = 0; i < n; ++i)
+    {
+        const float* s = &c.spheres[i];
+        scene.setSphere(i, {s[0], s[n], s[2*n], s[3*n]}, {s[4*n], s[5*n], s[6*n]}, {s[7*n], s[8*n], s[9*n]});
+    }
+
+    unsigned l = c.lights.size() / SceneStore::LIGHT_FIELDS;
+    scene.resizeLights(l);
+    for (unsigned i = 0; i < l; ++i)
+    {
+        const float* s = &c.lights[i];
+        scene.setLight(i, {s[0], s[l], s[2*l], s[3*l]});
+    }
+
+    cameraOrigin = c.cameraOrigin;
+    cameraTarget = c.cameraTarget;
+    ambientLight = c.ambientLight;
+}
+
+bool Timeline::step(double T, SceneStore& scene)
+{
+    updateScene = false;
+    updateCamera = false;
+    updateLights = false;
+
+    unsigned tic = ticAt(T);
+    if (tic > last_)
+        return false;
+
+    // a new tic, or a seek
+    unsigned c = checkpointAt(tic);
+    if (c != applied_)
+    {
+        restore(checkpoints_[c], scene);
+        applied_ = c;
+        updateScene = true;
+        updateCamera = true;
+        updateLights = true;
+    }
+
+    unsigned u = updateAt(tic);
+    if (u < updates_.size())
+        run(updates_[u], T, scene, checkpoints_[c]);
+
+    return true;
+}
+
+void Timeline::run(const Segment& segment, double T, SceneStore& scene, const Checkpoint& from)
+{
+    for (unsigned k = segment.first; k < segment.first + segment.count; ++k)
+    {
+        // an action may resize the scene
+        unsigned ring = scene.size() ? scene.size() - 1 : 0;
+        float step = ring ? 360.0f / ring : 0;
+
+        const float* a = actions_[k].args;
+        switch (actions_[k].op)
+        {
+        case LIGHTS:
+            scene.resizeLights(a[0]);
+            updateLights = true;
+            break;
+
+        case LIGHT:
+            if (a[0] < scene.lightsSize())
+                scene.setLight(a[0], {a[1], a[2], a[3], a[4]});
+            updateLights = true;
+            break;
+
+        case AMBIENT:
+            ambientLight = a[0];
+            updateLights = true;
+            break;
+
+        case CAMERA:
+            cameraOrigin = {a[0], a[1], a[2]};
+            updateCamera = true;
+            break;
+
+        case TARGET:
+            cameraTarget = {a[0], a[1], a[2]};
+            updateCamera = true;
+            break;
+
+        case SPHERES:
+            scene.resize(a[0]);
+            updateScene = true;
+            break;
+
+        case SPHERE:
+            if (a[0] < scene.size())
+                scene.setSphere(a[0], {a[1], a[2], a[3], a[4]}, {a[5], a[6], a[7]}, {a[8], a[9], a[10]});
+            updateScene = true;
+            break;
+
+        case RING:
+        {
+            Rotation r(0, step);
+            for (unsigned i = 0; i < ring; ++i, r.next())
+            {
+                float c = r.c, s = r.s;
+                scene.setSphere(i+1, a[0] ? vec4{a[1] * c, a[1] * s, 0, a[2]} : vec4{a[1] * c, 0, a[1] * s, a[2]});
+            }
+            updateScene = true;
+            break;
+        }
+
+        case RING_COLOR:
+            for (unsigned i = 0; i < ring; ++i)
+                scene.setColor(i+1, {a[0], a[1], a[2]});
+            updateScene = true;
+            break;
+
+        case RING_ATTR:
+            for (unsigned i = 0; i < ring; ++i)
+                scene.setAttr(i+1, {a[0], a[1], a[2]});
+            updateScene = true;
+            break;
+
+        case SPIN:
+        {
+            Rotation r(T / a[2], step);
+            for (unsigned i = 0; i < ring; ++i, r.next())
+            {
+                scene.x(i+1) = a[1] * r.c;
+                if (a[0])
+                    scene.y(i+1) = a[1] * r.s;
+                else
+                    scene.z(i+1) = a[1] * r.s;
+            }
+            updateScene = true;
+            break;
+        }
+
+        case RISE:
+        {
+            // from where the checkpoint has the ring, if it has it
+            unsigned n = from.spheres.size() / SceneStore::FIELDS;
+            float dy = a[0] * (T - from.time) / 1000;
+            for (unsigned i = 0; i < ring; ++i)
+                scene.y(i+1) = (i+1 < n ? from.spheres[SceneStore::Y * n + i+1] : 0) + dy;
+            updateScene = true;
+            break;
+        }
+
+        case PULSE:
+        {
+            // 1 on the beat, 0 half way to the next one
+            float color = .5 * std::cos(2 * PI * beats.phase(T, a[0])) + .5;
+            for (unsigned i = 0; i < ring; ++i)
+                scene.setColor(i+1, {1, 1-color, color});
+            updateScene = true;
+            break;
+        }
+        }
+    }
+
+    // the light follows the camera
+    if (updateCamera && scene.lightsSize())
+    {
+        updateLights = true;
+        scene.setLightPosition(0, cameraOrigin);
+    }
+}
@@ -0,0 +1,115 @@
+#ifndef TIMELINE_HPP
+#define TIMELINE_HPP
+
+#include <string>
+#include <vector>
+#include "vec.hpp"
+#include "scene.hpp"
+#include "beatclock.hpp"
+
+/*
+  The animation, played on the music.
+
+  step() is given the music time and changes the scene, camera and lights
+  accordingly; it knows nothing about where the time comes from, so the
+  same timeline runs live (sf::Clock) or offline (frame number / frame rate).
+
+  The animation itself is data (timeline.txt), a list of segments counted
+  in beats (tics) of the music, on its tempo map (see beatclock.hpp), each
+  one a list of actions:
+
+    enter N     runs once, at the start of tic N
+    until N     runs every frame until the end of tic N (the earliest
+                one not over yet), after the enter of the tic if any
+
+  Every action is a function of the music time (and of the state the
+  segment starts from), never of the previous frame, so that step() can be
+  given any time: seeking to a tic costs the same as playing the next frame.
+  For that load() plays the timeline once, beat by beat: the state at the
+  start of each tic an enter runs on, or an until ends before, is kept as a
+  checkpoint. step() puts back the checkpoint of its tic when it is not the
+  one the scene holds already, then runs the until of that tic at T.
+  The timeline is over after the last tic of a segment.
+*/
+
+class Timeline
+{
+public:
+    Timeline();
+
+    // reads the segments, false (with a message on std::cout) on error
+    bool load(const char* path);
+    // same, from the text of a file
+    bool parse(const std::string& text, const char* path = "timeline");
+
+    // scene at T (ms of music), whatever the previous T; false once it is over
+    bool step(double T, SceneStore& scene);
+
+    // tic at T, tic n being beat n - 1 of the music, 0 before the first one
+    unsigned ticAt(double T) const;
+    // first ms of tic
+    double ticTime(unsigned tic) const;
+    // last tic of a segment, the timeline is over after it
+    unsigned lastTic() const { return last_; }
+
+    // tempo map (bpm and offset lines)
+    BeatClock beats;
+
+    // camera
+    vec3 cameraOrigin;
+    vec3 cameraTarget;
+
+    float ambientLight;
+
+    // what the last step() changed
+    bool updateCamera;
+    bool updateScene;
+    bool updateLights;
+
+private:
+    // an action of a segment and its arguments, see timeline.cpp
+    struct Action
+    {
+        int op;
+        float args[11];
+    };
+
+    struct Segment
+    {
+        unsigned tic;
+        unsigned first;     // actions, in actions_
+        unsigned count;
+    };
+
+    // everything step() may change, at the start of a tic
+    struct Checkpoint
+    {
+        unsigned tic;               // the first one it holds for
+        double time;                // ms
+        std::vector<float> spheres; // column after column, as in SceneStore
+        std::vector<float> lights;
+        vec3 cameraOrigin;
+        vec3 cameraTarget;
+        float ambientLight;
+    };
+
+    // actions run from the state of checkpoint `from`
+    void run(const Segment& segment, double T, SceneStore& scene, const Checkpoint& from);
+    void save(unsigned tic, const SceneStore& scene);
+    void restore(const Checkpoint& checkpoint, SceneStore& scene);
+
+    // checkpoint in effect at tic, and the until running on it
+    // (updates_.size() for none), binary searched
+    unsigned checkpointAt(unsigned tic) const;
+    unsigned updateAt(unsigned tic) const;
+
+    std::vector<Action> actions_;
+    std::vector<Segment> enters_;   // by tic
+    std::vector<Segment> updates_;  // by tic
+
+    std::vector<Checkpoint> checkpoints_;   // by tic, the first one at tic 0
+    unsigned last_;
+    unsigned applied_;  // checkpoint the scene was last given
+};
+
+#endif
@@ -0,0 +1,368 @@
+#include "upload.hpp"
+#include <algorithm>
+#include <cstring>
+
+void UploadStats::add(const UploadStats& s)
+{
+    bytes += s.bytes;
+    fullBytes += s.fullBytes;
+    ranges += s.ranges;
+    stalls += s.stalls;
+}
+
+/*****************/
+/* STREAM BUFFER */
+/*****************/
+
+StreamBuffer::StreamBuffer()
+    : persistent_(false), slotsNb_(1), current_(0), bytes_(0), unit_(0), names_(),
+      countLoc_(-1), strideLoc_(-1), count_(-1), stride_(-1)
+{
+    for (Slot& s : slots_)
+    {
+        s.buffer = 0;
+        s.texture = 0;
+        s.mapped = NULL;
+        s.fence = 0;
+    }
+}
+
+void StreamBuffer::init(GLuint program, const char* sampler, const char* count,
+                        const char* stride, GLuint unit, bool persistent)
+{
+    persistent_ = persistent;
+    slotsNb_ = persistent ? SLOTS : 1;
+    unit_ = unit;
+    names_[0] = sampler;
+    names_[1] = count;
+    names_[2] = stride;
+
+    for (unsigned i = 0; i < slotsNb_; ++i)
+        glGenTextures(1, &slots_[i].texture);
+
+    setProgram(program);
+}
+
+void StreamBuffer::setProgram(GLuint program)
+{
+    glUniform1i(glGetUniformLocation(program, names_[0]), unit_);
+    countLoc_ = glGetUniformLocation(program, names_[1]);
+    strideLoc_ = glGetUniformLocation(program, names_[2]);
+
+    // a variant may have the count as a constant, its location being -1
+    if (count_ >= 0)
+    {
+        glUniform1i(countLoc_, count_);
+        glUniform1i(strideLoc_, stride_);
+    }
+}
+
+void StreamBuffer::release()
+{
+    for (unsigned i = 0; i < slotsNb_; ++i)
+    {
+        Slot& s = slots_[i];
+        if (s.fence)
+            glDeleteSync(s.fence);
+        if (s.buffer)
+        {
+            if (s.mapped)
+            {
+                glBindBuffer(GL_TEXTURE_BUFFER, s.buffer);
+                glUnmapBuffer(GL_TEXTURE_BUFFER);
+            }
+            glDeleteBuffers(1, &s.buffer);
+        }
+        s.buffer = 0;
+        s.mapped = NULL;
+        s.fence = 0;
+    }
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+}
+
+void StreamBuffer::allocate(const ColumnBlock& block)
+{
+    // buffer storage is immutable, a new size means new buffers
+    release();
+    bytes_ = block.bytes();
+
+    for (unsigned i = 0; i < slotsNb_; ++i)
+    {
+        Slot& s = slots_[i];
+        s.pending.assign(block.columns(), ColumnBlock::Range{0, block.size()});
+        if (!bytes_)
+            continue;
+
+        glGenBuffers(1, &s.buffer);
+        glBindBuffer(GL_TEXTURE_BUFFER, s.buffer);
+        if (persistent_)
+        {
+            GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+            glBufferStorage(GL_TEXTURE_BUFFER, bytes_, NULL, flags);
+            s.mapped = (float*)glMapBufferRange(GL_TEXTURE_BUFFER, 0, bytes_, flags);
+        }
+        else
+            glBufferData(GL_TEXTURE_BUFFER, bytes_, NULL, GL_DYNAMIC_DRAW);
+
+        glActiveTexture(GL_TEXTURE0 + unit_);
+        glBindTexture(GL_TEXTURE_BUFFER, s.texture);
+        glTexBuffer(GL_TEXTURE_BUFFER, GL_R32F, s.buffer);
+    }
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    glActiveTexture(GL_TEXTURE0);
+
+    current_ = slotsNb_ - 1;
+}
+
+void StreamBuffer::wait(Slot& s, UploadStats& stats)
+{
+    if (!s.fence)
+        return;
+
+    // three copies should leave the GPU enough frames to be done with it
+    if (glClientWaitSync(s.fence, 0, 0) == GL_TIMEOUT_EXPIRED)
+    {
+        ++stats.stalls;
+        while (glClientWaitSync(s.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000) == GL_TIMEOUT_EXPIRED)
+            ;
+    }
+    glDeleteSync(s.fence);
+    s.fence = 0;
+}
+
+void StreamBuffer::write(Slot& s, const ColumnBlock& block, UploadStats& stats)
+{
+    unsigned capacity = block.capacity();
+
+    if (!s.mapped)
+        glBindBuffer(GL_TEXTURE_BUFFER, s.buffer);
+
+    for (unsigned c = 0; c < block.columns(); ++c)
+    {
+        ColumnBlock::Range r = s.pending[c];
+        r.end = std::min(r.end, block.size());
+        if (r.empty())
+            continue;
+
+        unsigned offset = c * capacity + r.begin;
+        unsigned bytes = (r.end - r.begin) * sizeof(float);
+        if (s.mapped)
+            memcpy(s.mapped + offset, block.data() + offset, bytes);
+        else
+            glBufferSubData(GL_TEXTURE_BUFFER, offset * sizeof(float), bytes, block.data() + offset);
+
+        stats.bytes += bytes;
+        ++stats.ranges;
+    }
+
+    if (!s.mapped)
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+    s.pending.assign(block.columns(), ColumnBlock::Range{0, 0});
+}
+
+void StreamBuffer::upload(ColumnBlock& block, UploadStats& stats)
+{
+    stats.fullBytes += block.bytes();
+
+    if (block.moved() || block.bytes() != bytes_ || slots_[0].pending.empty())
+        allocate(block);
+    else
+        for (unsigned i = 0; i < slotsNb_; ++i)
+            for (unsigned c = 0; c < block.columns(); ++c)
+                slots_[i].pending[c].merge(block.dirty(c));
+    block.clean();
+
+    count_ = block.size();
+    stride_ = block.capacity();
+    glUniform1i(countLoc_, count_);
+    glUniform1i(strideLoc_, stride_);
+
+    // nothing new since the copy in use was written
+    bool changed = false;
+    for (const ColumnBlock::Range& r : slots_[current_].pending)
+        changed |= !r.empty();
+    if (!changed || !bytes_)
+        return;
+
+    current_ = (current_ + 1) % slotsNb_;
+    Slot& s = slots_[current_];
+    wait(s, stats);
+    write(s, block, stats);
+
+    glActiveTexture(GL_TEXTURE0 + unit_);
+    glBindTexture(GL_TEXTURE_BUFFER, s.texture);
+    glActiveTexture(GL_TEXTURE0);
+}
+
+void StreamBuffer::fence()
+{
+    if (!persistent_ || !bytes_)
+        return;
+
+    Slot& s = slots_[current_];
+    if (s.fence)
+        glDeleteSync(s.fence);
+    s.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+/******************/
+/* SCENE UPLOADER */
+/******************/
+
+SceneUploader::SceneUploader()
+    : persistent_(false), bvhBuffers_(), bvhTextures_(), unit_(0), bvhSizeLoc_(-1), bvhSize_(0),
+      occluderBuffer_(0), occluderTexture_(0), occluderListsLoc_(-1), occluderLists_(0),
+      tileBuffer_(0), tileTexture_(0), screenTileLoc_(-1), tilesXLoc_(-1), screenTile_(0), tilesX_(0), frame_(), last_(), total_(), frames_(0)
+{
+}
+
+void SceneUploader::init(GLuint program, GLuint unit)
+{
+    persistent_ = hasGlVersion(4, 4) || hasGlExtension("GL_ARB_buffer_storage");
+    unit_ = unit;
+    spheres_.init(program, "spheres", "objNb", "stride", unit, persistent_);
+    lights_.init(program, "lights", "lNb", "lightStride", unit + 1, persistent_);
+
+    const GLenum formats[2] = {GL_RGBA32F, GL_R32I};
+    glGenBuffers(2, bvhBuffers_);
+    glGenTextures(2, bvhTextures_);
+    for (int i = 0; i < 2; ++i)
+    {
+        // a buffer name is only an object once bound
+        glBindBuffer(GL_TEXTURE_BUFFER, bvhBuffers_[i]);
+        glActiveTexture(GL_TEXTURE0 + unit + 2 + i);
+        glBindTexture(GL_TEXTURE_BUFFER, bvhTextures_[i]);
+        glTexBuffer(GL_TEXTURE_BUFFER, formats[i], bvhBuffers_[i]);
+    }
+    GLuint* lists[2][2] = {{&occluderBuffer_, &occluderTexture_}, {&tileBuffer_, &tileTexture_}};
+    for (int i = 0; i < 2; ++i)
+    {
+        glGenBuffers(1, lists[i][0]);
+        glGenTextures(1, lists[i][1]);
+        glBindBuffer(GL_TEXTURE_BUFFER, *lists[i][0]);
+        glActiveTexture(GL_TEXTURE0 + unit + 4 + i);
+        glBindTexture(GL_TEXTURE_BUFFER, *lists[i][1]);
+        glTexBuffer(GL_TEXTURE_BUFFER, GL_R32I, *lists[i][0]);
+    }
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    glActiveTexture(GL_TEXTURE0);
+
+    bvhSizeLoc_ = glGetUniformLocation(program, "bvhSize");
+    glUniform1i(bvhSizeLoc_, 0);
+    glUniform1i(glGetUniformLocation(program, "bvhNodes"), unit + 2);
+    glUniform1i(glGetUniformLocation(program, "bvhPrims"), unit + 3);
+    occluderListsLoc_ = glGetUniformLocation(program, "occluderLists");
+    glUniform1i(occluderListsLoc_, 0);
+    glUniform1i(glGetUniformLocation(program, "occluders"), unit + 4);
+    screenTileLoc_ = glGetUniformLocation(program, "screenTile");
+    tilesXLoc_ = glGetUniformLocation(program, "tilesX");
+    glUniform1i(screenTileLoc_, 0);
+    glUniform1i(glGetUniformLocation(program, "tileSpheres"), unit + 5);
+}
+
+void SceneUploader::setProgram(GLuint program)
+{
+    spheres_.setProgram(program);
+    lights_.setProgram(program);
+
+    bvhSizeLoc_ = glGetUniformLocation(program, "bvhSize");
+    glUniform1i(bvhSizeLoc_, bvhSize_);
+    glUniform1i(glGetUniformLocation(program, "bvhNodes"), unit_ + 2);
+    glUniform1i(glGetUniformLocation(program, "bvhPrims"), unit_ + 3);
+    occluderListsLoc_ = glGetUniformLocation(program, "occluderLists");
+    glUniform1i(occluderListsLoc_, occluderLists_);
+    glUniform1i(glGetUniformLocation(program, "occluders"), unit_ + 4);
+    screenTileLoc_ = glGetUniformLocation(program, "screenTile");
+    tilesXLoc_ = glGetUniformLocation(program, "tilesX");
+    glUniform1i(screenTileLoc_, screenTile_);
+    glUniform1i(tilesXLoc_, tilesX_);
+    glUniform1i(glGetUniformLocation(program, "tileSpheres"), unit_ + 5);
+}
+
+void SceneUploader::uploadSpheres(SceneStore& scene)
+{
+    spheres_.upload(scene.sphereBlock(), frame_);
+}
+
+void SceneUploader::uploadLights(SceneStore& scene)
+{
+    lights_.upload(scene.lightBlock(), frame_);
+}
+
+void SceneUploader::uploadBvh(const Bvh& bvh, bool prims)
+{
+    const std::vector<BvhNode>& nodes = bvh.nodes();
+    const std::vector<int>& indices = bvh.prims();
+    unsigned bytes[2] = {unsigned(nodes.size() * sizeof(BvhNode)), unsigned(indices.size() * sizeof(int))};
+
+    // BvhNode is two RGBA32F texels, the ints being stored as floats
+    std::vector<float> texels(nodes.size() * 8);
+    for (unsigned i = 0; i < nodes.size(); ++i)
+    {
+        const BvhNode& n = nodes[i];
+        float* t = &texels[8 * i];
+        t[0] = n.min[0]; t[1] = n.min[1]; t[2] = n.min[2]; t[3] = n.index;
+        t[4] = n.max[0]; t[5] = n.max[1]; t[6] = n.max[2]; t[7] = n.count;
+    }
+    const void* data[2] = {texels.data(), indices.data()};
+
+    for (int i = 0; i < (prims ? 2 : 1); ++i)
+    {
+        glBindBuffer(GL_TEXTURE_BUFFER, bvhBuffers_[i]);
+        glBufferData(GL_TEXTURE_BUFFER, bytes[i], data[i], GL_DYNAMIC_DRAW);
+        frame_.bytes += bytes[i];
+        frame_.fullBytes += bytes[i];
+        ++frame_.ranges;
+    }
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+    bvhSize_ = nodes.size();
+    glUniform1i(bvhSizeLoc_, bvhSize_);
+}
+
+void SceneUploader::uploadLists(GLuint buffer, const std::vector<int>& offsets, const std::vector<int>& indices)
+{
+    // the bounds are texel indices, the lists starting after them
+    std::vector<int> texels(offsets.size() + indices.size());
+    for (unsigned l = 0; l < offsets.size(); ++l)
+        texels[l] = offsets.size() + offsets[l];
+    std::copy(indices.begin(), indices.end(), texels.begin() + offsets.size());
+
+    unsigned bytes = texels.size() * sizeof(int);
+    glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+    glBufferData(GL_TEXTURE_BUFFER, bytes, texels.data(), GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    frame_.bytes += bytes;
+    frame_.fullBytes += bytes;
+    ++frame_.ranges;
+}
+
+void SceneUploader::uploadOccluders(const OccluderLists& lists)
+{
+    occluderLists_ = !lists.empty();
+    glUniform1i(occluderListsLoc_, occluderLists_);
+    if (!lists.empty())
+        uploadLists(occluderBuffer_, lists.offsets(), lists.indices());
+}
+
+void SceneUploader::uploadScreenTiles(const ScreenTiles& tiles)
+{
+    screenTile_ = tiles.empty() ? 0 : SCREEN_TILE;
+    tilesX_ = tiles.tilesX();
+    glUniform1i(screenTileLoc_, screenTile_);
+    glUniform1i(tilesXLoc_, tilesX_);
+    if (!tiles.empty())
+        uploadLists(tileBuffer_, tiles.offsets(), tiles.indices());
+}
+
+void SceneUploader::endFrame()
+{
+    spheres_.fence();
+    lights_.fence();
+
+    last_ = frame_;
+    total_.add(frame_);
+    frame_ = UploadStats();
+    ++frames_;
+}
@@ -0,0 +1,159 @@
+#ifndef UPLOAD_HPP
+#define UPLOAD_HPP
+
+#include <vector>
+#include "gl.hpp"
+#include "scene.hpp"
+#include "bvh.hpp"
+#include "occluders.hpp"
+#include "screentiles.hpp"
+
+/*
+  Scene data for fragment.glsl.
+
+  The SceneStore blocks go as they are into buffer objects read through
+  texture buffers (samplerBuffer spheres/lights, one float per texel), so the
+  shader sees the same columns as the CPU, with no size limit but
+  GL_MAX_TEXTURE_BUFFER_SIZE.
+
+  Only the dirty ranges of each column are written. With GL 4.4 (or
+  ARB_buffer_storage) every block has three persistently mapped copies used
+  in turn, each one guarded by a fence set after the frame reading it, so
+  the CPU writes into a copy the GPU is done with instead of waiting for it;
+  each copy catches up on every range written since its own last turn.
+  Without it there is a single buffer updated with glBufferSubData.
+
+  The BVH is simply respecified with glBufferData: its nodes as RGBA32F
+  texels (bvhNodes, two per node) and its sphere indices as R32I (bvhPrims),
+  which a refit leaves as they were. So are the occluder lists (R32I,
+  occluders): the bounds of each light's list, then the lists, and the
+  screen tile lists the same way (tileSpheres).
+*/
+
+// what the uploads cost
+struct UploadStats
+{
+    unsigned long bytes;      // written to GL
+    unsigned long fullBytes;  // what uploading the whole blocks would have been
+    unsigned ranges;          // writes (one per dirty column range)
+    unsigned stalls;          // fences that were not signaled yet
+
+    void add(const UploadStats& s);
+};
+
+// one ColumnBlock on the GPU
+class StreamBuffer
+{
+public:
+    static const unsigned SLOTS = 3;
+
+    StreamBuffer();
+
+    // binds the sampler of program (in use) to texture unit `unit`; count
+    // and stride name the uniforms taking the rows and floats per column
+    void init(GLuint program, const char* sampler, const char* count, const char* stride,
+              GLuint unit, bool persistent);
+    // same bindings and last count and stride for another program (in use)
+    void setProgram(GLuint program);
+
+    // writes what changed in block since the last upload, and cleans it
+    void upload(ColumnBlock& block, UploadStats& stats);
+
+    // to call once the draw reading the data is submitted
+    void fence();
+
+private:
+    struct Slot
+    {
+        GLuint buffer;
+        GLuint texture;
+        float* mapped;      // persistent mapping, NULL without buffer storage
+        GLsync fence;
+        std::vector<ColumnBlock::Range> pending;  // per column, not yet in this copy
+    };
+
+    void allocate(const ColumnBlock& block);
+    void release();
+    void wait(Slot& s, UploadStats& stats);
+    void write(Slot& s, const ColumnBlock& block, UploadStats& stats);
+
+    bool persistent_;
+    unsigned slotsNb_;
+    Slot slots_[SLOTS];
+    unsigned current_;  // slot the texture unit points to
+    unsigned bytes_;    // size of each copy
+    GLuint unit_;
+    const char* names_[3];  // sampler, count and stride uniforms
+    GLint countLoc_;
+    GLint strideLoc_;
+    GLint count_;       // last values sent, -1 before the first upload
+    GLint stride_;
+};
+
+class SceneUploader
+{
+public:
+    SceneUploader();
+
+    // binds the spheres, lights, bvhNodes, bvhPrims, occluders and
+    // tileSpheres samplers of program (in use) to the texture units `unit`
+    // to `unit + 5`
+    void init(GLuint program, GLuint unit = 0);
+    // switches to another program built from fragment.glsl (in use), giving
+    // it the bindings and the uniforms the uploads set so far
+    void setProgram(GLuint program);
+
+    // whether the buffers are persistently mapped (GL 4.4)
+    bool persistent() const { return persistent_; }
+
+    void uploadSpheres(SceneStore& scene);
+    void uploadLights(SceneStore& scene);
+    // an empty bvh makes the shader test every sphere; prims can be skipped
+    // after a refit
+    void uploadBvh(const Bvh& bvh, bool prims = true);
+    // empty lists make shadow rays test every sphere
+    void uploadOccluders(const OccluderLists& lists);
+    // empty tiles make primary rays test every sphere
+    void uploadScreenTiles(const ScreenTiles& tiles);
+
+    // to call once the frame is drawn: fences the buffers and closes the stats
+    void endFrame();
+
+    const UploadStats& lastFrame() const { return last_; }
+    const UploadStats& total() const { return total_; }
+    unsigned frames() const { return frames_; }
+
+private:
+    // offsets and indices of OccluderLists or ScreenTiles
+    void uploadLists(GLuint buffer, const std::vector<int>& offsets, const std::vector<int>& indices);
+
+    bool persistent_;
+    StreamBuffer spheres_;
+    StreamBuffer lights_;
+
+    // nodes and prims
+    GLuint bvhBuffers_[2];
+    GLuint bvhTextures_[2];
+    GLuint unit_;
+    GLint bvhSizeLoc_;
+    GLint bvhSize_;
+
+    GLuint occluderBuffer_;
+    GLuint occluderTexture_;
+    GLint occluderListsLoc_;
+    GLint occluderLists_;
+
+    GLuint tileBuffer_;
+    GLuint tileTexture_;
+    GLint screenTileLoc_;
+    GLint tilesXLoc_;
+    GLint screenTile_;
+    GLint tilesX_;
+
+    UploadStats frame_;
+    UploadStats last_;
+    UploadStats total_;
+    unsigned frames_;
+};
+
+#endif
@@ -0,0 +1,91 @@
+#ifndef VEC_HPP
+#define VEC_HPP
+
+#include <cmath>
+
+/*********/
+/* TYPES */
+/*********/
+
+struct vec2
+{
+    float x;
+    float y;
+};
+struct vec3
+{
+    float x;
+    float y;
+    float z;
+};
+struct vec4
+{
+    float x;
+    float y;
+    float z;
+    float w;
+};
+
+/********************/
+/* USEFUL FUNCTIONS */
+/********************/
+
+inline float dot(const vec3& u, const vec3& v)
+{
+    return u.x * v.x + u.y * v.y + u.z * v.z;
+}
+inline float norm(const vec3& v)
+{
+    return sqrt(v.x * v.x + v.y * v.y + v.z * v.z);
+}
+inline vec3 normalize(const vec3& v)
+{
+    vec3 r;
+    float n = norm(v);
+    r.x = v.x / n;
+    r.y = v.y / n;
+    r.z = v.z / n;
+    return r;
+}
+inline vec3 operator+(const vec3& u, const vec3& v)
+{
+    vec3 w;
+    w.x = u.x + v.x;
+    w.y = u.y + v.y;
+    w.z = u.z + v.z;
+    return w;
+}
+inline vec3 operator-(const vec3& u, const vec3& v)
+{
+    vec3 w;
+    w.x = u.x - v.x;
+    w.y = u.y - v.y;
+    w.z = u.z - v.z;
+    return w;
+}
+inline vec3 operator-(const vec3& v)
+{
+    vec3 w;
+    w.x = -v.x;
+    w.y = -v.y;
+    w.z = -v.z;
+    return w;
+}
+inline vec3 operator*(float a, const vec3& v)
+{
+    vec3 w;
+    w.x = a * v.x;
+    w.y = a * v.y;
+    w.z = a * v.z;
+    return w;
+}
+inline vec3 cross(const vec3& u, const vec3& v)
+{
+    vec3 w;
+    w.x = u.y * v.z - u.z * v.y;
+    w.y = u.z * v.x - u.x * v.z;
+    w.z = u.x * v.y - u.y * v.x;
+    return w;
+}
+
+#endif
@@ -0,0 +1,255 @@
+#include "wavefront.hpp"
+#include "screentiles.hpp"
+#include <algorithm>
+#include <chrono>
+
+static double now()
+{
+    using namespace std::chrono;
+    return duration<double>(steady_clock::now().time_since_epoch()).count();
+}
+
+const char* waveStageName(WaveStage stage)
+{
+    static const char* names[] = {"generate", "closest hit", "shade", "shadow", "reflect"};
+    return names[stage];
+}
+
+void WavefrontStats::add(const WavefrontStats& s)
+{
+    for (int i = 0; i < WAVE_STAGES; ++i)
+    {
+        time[i] += s.time[i];
+        rays[i] += s.rays[i];
+    }
+}
+
+void Wavefront::reserve(unsigned rays, unsigned lights)
+{
+    if (x_.size() < rays)
+    {
+        x_.resize(rays);
+        y_.resize(rays);
+        ox_.resize(rays);
+        oy_.resize(rays);
+        oz_.resize(rays);
+        dx_.resize(rays);
+        dy_.resize(rays);
+        dz_.resize(rays);
+        from_.resize(rays);
+        attenuation_.resize(rays);
+        color_.resize(rays);
+        hit_.resize(rays);
+        dist_.resize(rays);
+        inter_.resize(rays);
+        normal_.resize(rays);
+        reflected_.resize(rays);
+    }
+    if (lDir_.size() < rays * lights)
+    {
+        lDir_.resize(rays * lights);
+        lit_.resize(rays * lights);
+    }
+}
+
+void Wavefront::move(unsigned k, unsigned m)
+{
+    x_[m] = x_[k];
+    y_[m] = y_[k];
+    ox_[m] = ox_[k];
+    oy_[m] = oy_[k];
+    oz_[m] = oz_[k];
+    dx_[m] = dx_[k];
+    dy_[m] = dy_[k];
+    dz_[m] = dz_[k];
+    from_[m] = from_[k];
+    attenuation_[m] = attenuation_[k];
+    color_[m] = color_[k];
+    hit_[m] = hit_[k];
+    dist_[m] = dist_[k];
+}
+
+void Wavefront::closestHits(const Scene& sc, unsigned n, bool first, const TileWalk& walk,
+                            RayStats* stats, RayStats* primary)
+{
+    SphereColumns spheres = sc.store->sphereColumns();
+    RayColumns rays = {&ox_[0], &oy_[0], &oz_[0], &dx_[0], &dy_[0], &dz_[0]};
+    RayStats found = RayStats();
+
+    for (unsigned k = 0; k < n; ++k)
+    {
+        hit_[k] = -1;
+        dist_[k] = 1e30;
+    }
+
+    int lanes = simdLevel() == SIMD_AVX512 ? 16 : simdLevel() == SIMD_AVX2 ? 8 : 1;
+    if (!sc.bvh && first && sc.screenTiles)
+    {
+        // runs of primary rays in the same screen tile, against its spheres
+        const ScreenTiles& tiles = *sc.screenTiles;
+        for (unsigned k = 0, end; k < n; k = end)
+        {
+            unsigned t = tiles.tile(x_[k], y_[k]);
+            for (end = k + 1; end < n && tiles.tile(x_[end], y_[end]) == t; ++end)
+                ;
+            RayColumns run = {&ox_[k], &oy_[k], &oz_[k], &dx_[k], &dy_[k], &dz_[k]};
+            SphereColumns candidates = tiles.columns(t);
+            closestHitPacket(run, end - k, candidates, &from_[k], &hit_[k], &dist_[k]);
+            for (unsigned j = k; j < end; ++j)
+                if (hit_[j] >= 0)
+                    hit_[j] = tiles.sphere(t, hit_[j]);
+            found.rays += end - k;
+            found.spheres += (unsigned long long)candidates.n * ((end - k + lanes - 1) / lanes);
+        }
+    }
+    else if (!sc.bvh)
+    {
+        // a ray per SIMD lane, so that each sphere is loaded once for 8 or 16
+        closestHitPacket(rays, n, spheres, &from_[0], &hit_[0], &dist_[0]);
+        found.rays += n;
+        found.spheres += (unsigned long long)spheres.n * ((n + lanes - 1) / lanes);
+    }
+    else if (first && walk.packet > 1)
+    {
+        // the primary rays are still in the walk's order: packets of
+        // neighbouring pixels, as renderTile() makes them
+        int size = std::min(int(walk.packet), Bvh::MAX_PACKET);
+        for (unsigned k = 0; k < n; k += size)
+        {
+            RayColumns packet = {&ox_[k], &oy_[k], &oz_[k], &dx_[k], &dy_[k], &dz_[k]};
+            sc.bvh->closestHitPacket(packet, std::min(n - k, unsigned(size)), spheres, &hit_[k], &dist_[k],
+                                     &found);
+        }
+    }
+    else
+    {
+        for (unsigned k = 0; k < n; ++k)
+            hit_[k] = sc.bvh->closestHit({ox_[k], oy_[k], oz_[k]}, {dx_[k], dy_[k], dz_[k]}, spheres,
+                                         from_[k], dist_[k], &found);
+    }
+
+    if (stats)
+        stats->add(found);
+    if (first && primary)
+        primary->add(found);
+}
+
+void Wavefront::renderTile(const Scene& sc, Framebuffer& fb, unsigned x0, unsigned y0, unsigned x1, unsigned y1,
+                           const TileWalk& walk, RayStats* stats, RayStats* primary, WavefrontStats* stages)
+{
+    SphereColumns spheres = sc.store->sphereColumns();
+    unsigned lights = sc.store->lightsSize();
+
+    WavefrontStats times = WavefrontStats();
+    double t = now();
+    // stage s took the time since the last one, for n rays
+    auto stage = [&](WaveStage s, unsigned n)
+    {
+        double t_ = now();
+        times.time[s] += t_ - t;
+        times.rays[s] += n;
+        t = t_;
+    };
+
+    // generate
+    unsigned side = 1;
+    while (side < x1 - x0 || side < y1 - y0)
+        side *= 2;
+    reserve((x1 - x0) * (y1 - y0), lights);
+
+    unsigned n = 0;
+    for (unsigned i = 0; i < side * side; ++i)
+    {
+        unsigned x, y;
+        curvePoint(walk.order, side, i, x, y);
+        x += x0;
+        y += y0;
+        if (x >= x1 || y >= y1)
+            continue;
+
+        vec3 a, dir;
+        primaryRay(sc, x, y, a, dir);
+        x_[n] = x;
+        y_[n] = y;
+        ox_[n] = a.x;
+        oy_[n] = a.y;
+        oz_[n] = a.z;
+        dx_[n] = dir.x;
+        dy_[n] = dir.y;
+        dz_[n] = dir.z;
+        from_[n] = -1;
+        attenuation_[n] = 0;
+        color_[n] = vec3{0, 0, 0};
+        ++n;
+    }
+    stage(WAVE_GENERATE, n);
+
+    for (int bounce = 0; n > 0; ++bounce)
+    {
+        // closest hit, then misses and rays past the limit are done
+        unsigned in = n;
+        closestHits(sc, n, bounce == 0, walk, stats, primary);
+        unsigned m = 0;
+        for (unsigned k = 0; k < n; ++k)
+        {
+            if (hit_[k] < 0 || (attenuation_[k] += dist_[k]) > ATTENUATION_LIMIT)
+                setPixel(fb, x_[k], y_[k], color_[k]);
+            else
+                move(k, m++);
+        }
+        n = m;
+        stage(WAVE_CLOSEST_HIT, in);
+
+        // shade: where each ray is, and where it goes next
+        for (unsigned k = 0; k < n; ++k)
+        {
+            hitPoint(sc, {ox_[k], oy_[k], oz_[k]}, {dx_[k], dy_[k], dz_[k]}, hit_[k], dist_[k], inter_[k],
+                     normal_[k], reflected_[k]);
+            for (unsigned l = 0; l < lights; ++l)
+                lDir_[k * lights + l] = lightDir(sc, inter_[k], l);
+        }
+        stage(WAVE_SHADE, n);
+
+        // shadow
+        for (unsigned k = 0; k < n; ++k)
+            for (unsigned l = 0; l < lights; ++l)
+                lit_[k * lights + l] = !sceneAnyHit(sc, inter_[k], -lDir_[k * lights + l], spheres, hit_[k], l,
+                                                    stats);
+        stage(WAVE_SHADOW, n * lights);
+
+        // shade: compColor() with the shadows known
+        for (unsigned k = 0; k < n; ++k)
+        {
+            vec3 color = {0, 0, 0};
+            for (unsigned l = 0; l < lights; ++l)
+                if (lit_[k * lights + l])
+                    addLight(sc, hit_[k], normal_[k], reflected_[k], l, lDir_[k * lights + l], color);
+            color_[k] = addBounce(sc, color_[k], from_[k], surfaceColor(sc, hit_[k], color));
+        }
+        stage(WAVE_SHADE, 0);
+
+        // reflect, what stops is done
+        m = 0;
+        for (unsigned k = 0; k < n; ++k)
+        {
+            if (!reflects(sc, hit_[k], bounce, attenuation_[k]))
+            {
+                setPixel(fb, x_[k], y_[k], color_[k]);
+                continue;
+            }
+            from_[k] = hit_[k];
+            ox_[k] = inter_[k].x;
+            oy_[k] = inter_[k].y;
+            oz_[k] = inter_[k].z;
+            dx_[k] = -reflected_[k].x;
+            dy_[k] = -reflected_[k].y;
+            dz_[k] = -reflected_[k].z;
+            move(k, m++);
+        }
+        stage(WAVE_REFLECT, n);
+        n = m;
+    }
+
+    if (stages)
+        stages->add(times);
+}
@@ -0,0 +1,90 @@
+#ifndef WAVEFRONT_HPP
+#define WAVEFRONT_HPP
+
+#include <vector>
+#include "raytracer.hpp"
+
+/*
+  Wavefront (stream) tracing of a tile, the other way to run castRay().
+
+  castRay() follows one pixel through all its bounces, so that the batches
+  of the intersection kernels stop being full as soon as neighbouring
+  pixels part ways (one misses, another reflects). Here all the rays of a
+  tile go through one stage after the other, each stage a loop over a queue
+  of rays stored column by column:
+
+    generate     the primary rays, along the walk's curve
+    closest hit  the queue against the spheres: through the BVH by packets
+                 of `walk.packet` for the primary rays and one ray at a
+                 time after; without a BVH, a ray per SIMD lane against
+                 every sphere (closestHitPacket), full lanes at any bounce,
+                 the primary rays against the spheres of their screen tile
+                 (screentiles.hpp)
+    shade        intersection points, normals, reflected rays, then the
+                 colors once the shadow rays are known
+    shadow       one ray per live ray and light (anyHit)
+    reflect      rays on reflective spheres become the queue of the next
+                 bounce
+
+  Rays that miss, go past the attenuation limit or stop reflecting are
+  written to the framebuffer and dropped between stages, so that the queue
+  stays packed. Every ray computes what castRay() does, in the same order
+  and with its shading steps (hitPoint(), addLight()... of raytracer.hpp):
+  the pixels are the same.
+*/
+
+enum WaveStage
+{
+    WAVE_GENERATE,
+    WAVE_CLOSEST_HIT,
+    WAVE_SHADE,
+    WAVE_SHADOW,
+    WAVE_REFLECT,
+    WAVE_STAGES
+};
+
+const char* waveStageName(WaveStage stage);
+
+struct WavefrontStats
+{
+    double time[WAVE_STAGES];               // s
+    unsigned long long rays[WAVE_STAGES];   // entering the stage
+
+    void add(const WavefrontStats& s);
+};
+
+// the queues, kept from tile to tile by a worker
+class Wavefront
+{
+public:
+    // renderTile() of raytracer.hpp, stage times and rays added to stages
+    void renderTile(const Scene& sc, Framebuffer& fb, unsigned x0, unsigned y0, unsigned x1, unsigned y1,
+                    const TileWalk& walk, RayStats* stats = NULL, RayStats* primary = NULL,
+                    WavefrontStats* stages = NULL);
+
+private:
+    void reserve(unsigned rays, unsigned lights);
+    void closestHits(const Scene& sc, unsigned n, bool first, const TileWalk& walk,
+                     RayStats* stats, RayStats* primary);
+    // ray k moves to slot m <= k
+    void move(unsigned k, unsigned m);
+
+    // rays: pixel, origin, direction, sphere left (-1 for none), distance
+    // gone, color so far, closest hit
+    std::vector<unsigned> x_, y_;
+    std::vector<float> ox_, oy_, oz_, dx_, dy_, dz_;
+    std::vector<int> from_;
+    std::vector<float> attenuation_;
+    std::vector<vec3> color_;
+    std::vector<int> hit_;
+    std::vector<float> dist_;
+
+    // shading of the live rays
+    std::vector<vec3> inter_, normal_, reflected_;
+
+    // shadow ray of live ray k and light l at k * lights + l
+    std::vector<vec3> lDir_;
+    std::vector<unsigned char> lit_;
+};
+
+#endif
@@ -0,0 +1,45 @@
+#version 140
+
+// the scene drawn at a lower resolution (see resolution.hpp), stretched over
+// the window: bilinear, but without blending across the edges of spheres
+
+out vec4 vertexColor;
+
+uniform sampler2D scene;
+uniform ivec2 sceneSize;    // pixels drawn in scene
+uniform vec2 scale;         // scene pixels per window pixel
+
+// how fast a texel loses weight as its luma moves away from the nearest one
+const float edge = 8.0f;
+
+float luma(vec3 c)
+{
+    return dot(c, vec3(.299f, .587f, .114f));
+}
+
+vec3 texel(ivec2 p)
+{
+    return texelFetch(scene, clamp(p, ivec2(0), sceneSize - 1), 0).rgb;
+}
+
+void main()
+{
+    // in scene pixels, texel centers being on integers
+    vec2 pos = gl_FragCoord.xy * scale - .5f;
+    ivec2 p = ivec2(floor(pos));
+    vec2 f = pos - floor(pos);
+
+    vec3 c00 = texel(p);
+    vec3 c10 = texel(p + ivec2(1, 0));
+    vec3 c01 = texel(p + ivec2(0, 1));
+    vec3 c11 = texel(p + ivec2(1, 1));
+
+    // the nearest texel keeps its bilinear weight (at least 1/4), the others
+    // lose theirs where they are across an edge from it
+    float l = luma(texel(ivec2(floor(gl_FragCoord.xy * scale))));
+    vec4 w = vec4((1 - f.x) * (1 - f.y), f.x * (1 - f.y), (1 - f.x) * f.y, f.x * f.y);
+    w *= exp(-edge * abs(vec4(luma(c00), luma(c10), luma(c01), luma(c11)) - l));
+
+    vec3 color = w.x * c00 + w.y * c10 + w.z * c01 + w.w * c11;
+    vertexColor = vec4(color / (w.x + w.y + w.z + w.w), 1.0f);
+}
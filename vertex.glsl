@@ -1,8 +1,10 @@
-#version 130
+#version 140
 
-in vec3 vertex;
+// one triangle covering the screen, drawn without any vertex attribute:
+// vertices 0, 1, 2 go to (-1, -1), (3, -1), (-1, 3)
 
 void main()
 {
-    gl_Position = vec4(vertex, 1.0f);
+    vec2 vertex = vec2((gl_VertexID & 1) * 4 - 1, (gl_VertexID & 2) * 2 - 1);
+    gl_Position = vec4(vertex, 1.0f, 1.0f);
 }